@@ -27,45 +27,109 @@ OTHER DEALINGS IN THE SOFTWARE.
 
  */
 
+
+#include <ctype.h>
+#include <dlfcn.h>
 #include "audio_switch.h"
+#include "binary.h"
+#include "completion.h"
+#include "coordination.h"
+#include "history.h"
+#include "latency.h"
+#include "meter.h"
+#include "metrics.h"
 
 
 void showUsage(const char * appName) {
     printf("Usage: %s [-a] [-c] [-t type] [-n] -s device_name | -i device_id | -u device_uid\n"
            "  -a             : shows all devices\n"
            "  -c             : shows current device\n\n"
-           "  -f format      : output format (cli/human/json). Defaults to human.\n"
+           "  -f format      : output format (cli/human/json/binary). Defaults to human.\n"
            "  -t type        : device type (input/output/system/all).  Defaults to output.\n"
            "  -m mute        : sets the mute status (mute/unmute/toggle).  For input/output only.\n"
            "  -n             : cycles the audio device to the next one\n"
            "  -i device_id   : sets the audio device to the given device by id\n"
            "  -u device_uid  : sets the audio device to the given device by uid or a substring of the uid\n"
-           "  -s device_name : sets the audio device to the given device by name\n\n",appName);
+           "  -s device_name : sets the audio device to the given device by name\n\n"
+           "Aggregate devices:\n"
+           "  --aggregate name      : creates an aggregate device from the devices given with --members\n"
+           "  --multi-output name   : creates a multi-output device from the devices given with --members\n"
+           "  --members list        : comma separated member device names or uids\n"
+           "  --clock member        : member used as clock source.  Defaults to the first member.\n"
+           "  --drift list          : comma separated members to drift compensate, or \"all\"\n"
+           "  --make-default        : sets the created device as the default device of the type given with -t\n"
+           "  --destroy device      : destroys the aggregate device with exactly the given name or uid\n"
+           "  --list-aggregates     : shows all aggregate devices and their members\n\n"
+           "History:\n"
+           "  --history             : shows the history of device changes\n"
+           "  --history-enable      : starts recording the history of device changes\n"
+           "  --history-disable     : stops recording and removes the history\n\n"
+           "Metrics:\n"
+           "  --metrics             : shows switch counters and timings in the OpenMetrics format\n\n"
+           "Level meter:\n"
+           "  --meter               : shows the input levels of the current input device, or of the device given with -s, -u or -i\n"
+           "  --interval ms         : how often the levels are shown.  Defaults to 100.\n\n"
+           "Latency:\n"
+           "  --measure-latency     : measures the round-trip latency from the output to the input device\n"
+           "  --output device       : output device name or uid.  Defaults to the current output device.\n"
+           "  --input device        : input device name or uid.  Defaults to the current input device.\n\n"
+           "Shell completion:\n"
+           "  --complete prefix     : shows the device names starting with prefix, quoted for the shell unless -f cli is given\n"
+           "  --complete-uid prefix : shows the device uids starting with prefix\n"
+           "  --completion-script shell : shows the completion script for bash, zsh or fish\n\n",appName);
 }
 
+static struct option longOptions[] = {
+    {"aggregate",       required_argument, NULL, kOptionAggregate},
+    {"multi-output",    required_argument, NULL, kOptionMultiOutput},
+    {"members",         required_argument, NULL, kOptionMembers},
+    {"clock",           required_argument, NULL, kOptionClock},
+    {"drift",           required_argument, NULL, kOptionDrift},
+    {"make-default",    no_argument,       NULL, kOptionMakeDefault},
+    {"destroy",         required_argument, NULL, kOptionDestroy},
+    {"list-aggregates", no_argument,       NULL, kOptionListAggregates},
+    {"history",         no_argument,       NULL, kOptionHistory},
+    {"history-enable",  no_argument,       NULL, kOptionHistoryEnable},
+    {"history-disable", no_argument,       NULL, kOptionHistoryDisable},
+    {"metrics",         no_argument,       NULL, kOptionMetrics},
+    {"meter",           no_argument,       NULL, kOptionMeter},
+    {"interval",        required_argument, NULL, kOptionInterval},
+    {"measure-latency", no_argument,       NULL, kOptionMeasureLatency},
+    {"output",          required_argument, NULL, kOptionOutput},
+    {"input",           required_argument, NULL, kOptionInput},
+    {"complete",        required_argument, NULL, kOptionComplete},
+    {"complete-uid",    required_argument, NULL, kOptionCompleteUID},
+    {"completion-script", required_argument, NULL, kOptionCompletionScript},
+    {NULL,              0,                 NULL, 0}
+};
+
 int runAudioSwitch(int argc, const char * argv[]) {
-    char requestedDeviceName[256];
-    char printableDeviceName[256];
-    int requestedDeviceID;
-    char requestedDeviceUID[256];
-    AudioDeviceID chosenDeviceID = kAudioDeviceUnknown;
-    ASDeviceType typeRequested = kAudioTypeUnknown;
-    ASOutputType outputRequested = kFormatHuman;
-    ASMuteType muteRequested = kToggleMute;
-    int function = 0;
-    int result = 0;
+    ASRequest request = {
+        .function = 0,
+        .typeRequested = kAudioTypeUnknown,
+        .outputRequested = kFormatHuman,
+        .muteRequested = kToggleMute,
+        .aggregateType = kAggregateNormal,
+        .meterInterval = kMeterDefaultInterval,
+    };
+    ASContext * context = NULL;
+
+    // counters collected during this run are published on the way out
+    atexit(flushMetrics);
 
     int c;
-    while ((c = getopt(argc, (char **)argv, "hacm:nt:f:i:u:s:")) != -1) {
+    while ((c = getopt_long(argc, (char **)argv, "hacm:nt:f:i:u:s:", longOptions, NULL)) != -1) {
         switch (c) {
             case 'f':
                 // format
                 if (strcmp(optarg, "cli") == 0) {
-                    outputRequested = kFormatCLI;
+                    request.outputRequested = kFormatCLI;
                 } else if (strcmp(optarg, "json") == 0) {
-                    outputRequested = kFormatJSON;
+                    request.outputRequested = kFormatJSON;
                 } else if (strcmp(optarg, "human") == 0) {
-                    outputRequested = kFormatHuman;
+                    request.outputRequested = kFormatHuman;
+                } else if (strcmp(optarg, "binary") == 0) {
+                    request.outputRequested = kFormatBinary;
                 } else {
                     printf("Unknown format %s\n", optarg);
                     showUsage(argv[0]);
@@ -74,28 +138,28 @@ int runAudioSwitch(int argc, const char * argv[]) {
                 break;
             case 'a':
                 // show all
-                function = kFunctionShowAll;
+                request.function = kFunctionShowAll;
                 break;
             case 'c':
                 // get current device
-                function = kFunctionShowCurrent;
+                request.function = kFunctionShowCurrent;
                 break;
 
             case 'h':
                 // show help
-                function = kFunctionShowHelp;
+                request.function = kFunctionShowHelp;
                 break;
                 
             case 'm':
                 // control the mute status of the interface selected with -t
-                function = kFunctionMute;
+                request.function = kFunctionMute;
                 // set the mute mode
                 if (strcmp(optarg, "mute") == 0) {
-                    muteRequested = kMute;
+                    request.muteRequested = kMute;
                 } else if (strcmp(optarg, "unmute") == 0) {
-                    muteRequested = kUnmute;
+                    request.muteRequested = kUnmute;
                 } else if (strcmp(optarg, "toggle") == 0) {
-                    muteRequested = kToggleMute;
+                    request.muteRequested = kToggleMute;
                 } else {
                     printf("Invalid mute operation type \"%s\" specified.\n", optarg);
                     showUsage(argv[0]);
@@ -105,527 +169,523 @@ int runAudioSwitch(int argc, const char * argv[]) {
                 
             case 'n':
                 // cycle to the next audio device
-                function = kFunctionCycleNext;
+                request.function = kFunctionCycleNext;
                 break;
                 
             case 'i':
                 // set the requestedDeviceID
-                function = kFunctionSetDeviceByID;
-                requestedDeviceID = atoi(optarg);
+                request.function = kFunctionSetDeviceByID;
+                request.requestedDeviceID = (AudioDeviceID)atoi(optarg);
                 break;
 
             case 'u':
                 // set the requestedDeviceUID
-                function = kFunctionSetDeviceByUID;
-                strcpy(requestedDeviceUID, optarg);
+                request.function = kFunctionSetDeviceByUID;
+                request.requestedDeviceUID = optarg;
                 break;
 
             case 's':
                 // set the requestedDeviceName
-                function = kFunctionSetDeviceByName;
-                strcpy(requestedDeviceName, optarg);
+                request.function = kFunctionSetDeviceByName;
+                request.requestedDeviceName = optarg;
                 break;
 
             case 't':
                 // set the requestedDeviceName
                 if (strcmp(optarg, "input") == 0) {
-                    typeRequested = kAudioTypeInput;
+                    request.typeRequested = kAudioTypeInput;
                 } else if (strcmp(optarg, "output") == 0) {
-                    typeRequested = kAudioTypeOutput;
+                    request.typeRequested = kAudioTypeOutput;
                 } else if (strcmp(optarg, "system") == 0) {
-                    typeRequested = kAudioTypeSystemOutput;
+                    request.typeRequested = kAudioTypeSystemOutput;
                 } else if (strcmp(optarg, "all") == 0) {
-                    typeRequested = kAudioTypeAll;
+                    request.typeRequested = kAudioTypeAll;
                 } else {
                     printf("Invalid device type \"%s\" specified.\n",optarg);
                     showUsage(argv[0]);
                     return 1;
                 }
                 break;
-        }
-    }
-    
-    if (function == kFunctionShowAll) {
-        switch(typeRequested) {
-            case kAudioTypeInput:
-            case kAudioTypeOutput:
-                showAllDevices(typeRequested, outputRequested);
+
+            case kOptionAggregate:
+            case kOptionMultiOutput:
+                // create an aggregate or multi-output device
+                request.function = kFunctionCreateAggregate;
+                request.aggregateType = (c == kOptionMultiOutput) ? kAggregateMultiOutput : kAggregateNormal;
+                request.aggregateName = optarg;
                 break;
-            case kAudioTypeSystemOutput:
-                showAllDevices(kAudioTypeOutput, outputRequested);
+
+            case kOptionMembers:
+                request.aggregateMembers = optarg;
                 break;
-            default:
-                showAllDevices(kAudioTypeInput, outputRequested);
-                showAllDevices(kAudioTypeOutput, outputRequested);
-        }
-        return 0;
-    }
-    if (function == kFunctionShowHelp) {
-        showUsage(argv[0]);
-        return 0;
-    }
-    if (function == kFunctionShowCurrent) {
-        if (typeRequested == kAudioTypeUnknown) typeRequested = kAudioTypeOutput;
-        showCurrentlySelectedDeviceID(typeRequested, outputRequested);
-        return 0;
-    }
 
-    if (typeRequested == kAudioTypeUnknown) typeRequested = kAudioTypeOutput;
+            case kOptionClock:
+                request.aggregateClock = optarg;
+                break;
 
-    if (function == kFunctionCycleNext) {
-        result = cycleNext(typeRequested);
-        return result;
-    }
+            case kOptionDrift:
+                request.aggregateDrift = optarg;
+                break;
 
-    if (function == kFunctionSetDeviceByID) {
-        chosenDeviceID = (AudioDeviceID)requestedDeviceID;
-        sprintf(printableDeviceName, "Device with ID: %d", chosenDeviceID);
-    }
+            case kOptionMakeDefault:
+                request.makeDefault = true;
+                break;
 
-    if (function == kFunctionSetDeviceByName && typeRequested != kAudioTypeAll) {
-        // find the id of the requested device
-        chosenDeviceID = getRequestedDeviceID(requestedDeviceName, typeRequested);
-        if (chosenDeviceID == kAudioDeviceUnknown) {
-            printf("Could not find an audio device named \"%s\" of type %s.  Nothing was changed.\n",requestedDeviceName, deviceTypeName(typeRequested));
-            return 1;
-        }
-        strcpy(printableDeviceName, requestedDeviceName);
-    }
+            case kOptionDestroy:
+                // destroy an aggregate device by name or uid
+                request.function = kFunctionDestroyAggregate;
+                request.aggregateName = optarg;
+                break;
 
-    if (function == kFunctionSetDeviceByUID) {
-        // find the id of the requested device
-        chosenDeviceID = getRequestedDeviceIDFromUIDSubstring(requestedDeviceUID, typeRequested);
-        if (chosenDeviceID == kAudioDeviceUnknown) {
-            printf("Could not find an audio device with UID \"%s\" of type %s.  Nothing was changed.\n", requestedDeviceUID, deviceTypeName(typeRequested));
-            return 1;
-        }
-        sprintf(printableDeviceName, "Device with UID: %s", getDeviceUID(chosenDeviceID));
-    }
+            case kOptionListAggregates:
+                request.function = kFunctionListAggregates;
+                break;
 
-    if (function == kFunctionMute) {
-        OSStatus status;
-        bool anyStatusError = false;
-        if (typeRequested == kAudioTypeUnknown) typeRequested = kAudioTypeInput;
-        
-        switch(typeRequested) {
-            case kAudioTypeInput: 
-            case kAudioTypeOutput:
-                status = setMute(typeRequested, muteRequested);
-                if(status != noErr) {
-                    printf("Failed setting mute state. Error: %d (%s)", status, GetMacOSStatusErrorString(status));
-                    return 1;
-                }
+            case kOptionHistory:
+                request.function = kFunctionShowHistory;
                 break;
-            case kAudioTypeAll:
-                status = setMute(kAudioTypeInput, muteRequested);
-                if(status != noErr) {
-                    printf("Failed setting mute state for input. Error: %d (%s)", status, GetMacOSStatusErrorString(status));
-                    anyStatusError = true;
-                }
-                status = setMute(kAudioTypeOutput, muteRequested);
-                if(status != noErr) {
-                    printf("Failed setting mute state for output. Error: %d (%s)", status, GetMacOSStatusErrorString(status));
-                    anyStatusError = true;
-                }
-                if (anyStatusError) {
+
+            case kOptionHistoryEnable:
+                request.function = kFunctionEnableHistory;
+                break;
+
+            case kOptionHistoryDisable:
+                request.function = kFunctionDisableHistory;
+                break;
+
+            case kOptionMetrics:
+                request.function = kFunctionShowMetrics;
+                break;
+
+            case kOptionMeter:
+                request.meter = true;
+                break;
+
+            case kOptionInterval:
+                request.meterInterval = (UInt32)atoi(optarg);
+                if (request.meterInterval == 0) {
+                    printf("Invalid interval \"%s\" specified.\n", optarg);
+                    showUsage(argv[0]);
                     return 1;
                 }
                 break;
-            case kAudioTypeSystemOutput:
-                printf("audio device \"%s\" may not be muted\n", deviceTypeName(typeRequested));
-                return 1;
+
+            case kOptionMeasureLatency:
+                request.function = kFunctionMeasureLatency;
                 break;
-        }
-        return 0;
-    }
 
-    
-    if (typeRequested == kAudioTypeAll && function == kFunctionSetDeviceByName) {
-        // special case for all - process each one separately
-        result = setAllDevicesByName(requestedDeviceName);
-    } else {
-        // require a chose
-        if (!chosenDeviceID) {
-            printf("Please specify audio device.\n");
-            showUsage(argv[0]);
-            return 1;
+            case kOptionOutput:
+                request.latencyOutput = optarg;
+                break;
+
+            case kOptionInput:
+                request.latencyInput = optarg;
+                break;
+
+            case kOptionComplete:
+            case kOptionCompleteUID:
+                request.function = (c == kOptionCompleteUID) ? kFunctionCompleteUID : kFunctionComplete;
+                request.completionPrefix = optarg;
+                break;
+
+            case kOptionCompletionScript:
+                request.function = kFunctionCompletionScript;
+                request.completionShell = optarg;
+                break;
         }
+    }
 
-        // choose the requested audio device
-        result = setDevice(chosenDeviceID, typeRequested);
-        printf("%s audio device set to \"%s\"\n", deviceTypeName(typeRequested), printableDeviceName);
+    if (request.meter && request.function != kFunctionShowHelp) {
+        request.function = kFunctionMeter;
     }
 
+    if (request.function == kFunctionShowHelp) {
+        showUsage(argv[0]);
+        return 0;
+    }
+    if (request.outputRequested == kFormatBinary && request.function != kFunctionShowAll && request.function != kFunctionShowCurrent) {
+        fprintf(stderr, "The binary format is only available with -a and -c.\n");
+        return 1;
+    }
 
+    OSStatus status = ASContextCreate(&context);
+    if (status != noErr) {
+        printf("Failed to initialize. Error: %d (%s)\n", status, statusErrorString(status));
+        return 1;
+    }
+    int result = runRequest(context, &request, argv[0]);
+    ASContextDispose(context);
     return result;
 }
 
-const char * getDeviceUID(AudioDeviceID deviceID) {
-    CFStringRef deviceUID = NULL;
-    UInt32 dataSize = sizeof(deviceUID);
-    AudioObjectPropertyAddress propertyAddress = {
-        kAudioHardwarePropertyDevices,
-        kAudioObjectPropertyScopeGlobal,
-        kAudioObjectPropertyElementMaster
-    };
-    
-    propertyAddress.mSelector = kAudioDevicePropertyDeviceUID;
-    
-    OSStatus err = AudioObjectGetPropertyData(deviceID, &propertyAddress, 0, NULL, &dataSize, &deviceUID);
-    if (err != 0) {
-        // Handle error
-        return "";
-    }
+// what a set request switches to, handed through coordinateSet
+typedef struct {
+    ASContext * context;
+    const ASRequest * request;
+    AudioDeviceID deviceID;
+    const char * printableDeviceName;
+} ASSetTarget;
 
-    const char * deviceUID_string = NULL;
-    CFIndex length = CFStringGetLength(deviceUID);
-    CFIndex maxSize = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8) + 1;
-    deviceUID_string = (char *)malloc(maxSize);
+static int applySet(ASDeviceType typeRequested, void * userData) {
+    const ASSetTarget * target = (const ASSetTarget *)userData;
+    int result;
 
-    if (deviceUID_string) {
-        if (CFStringGetCString(deviceUID, deviceUID_string, maxSize, kCFStringEncodingUTF8)) {
-            CFRelease(deviceUID);
-            return deviceUID_string;
+    if (typeRequested == kAudioTypeAll && target->request->function == kFunctionSetDeviceByName) {
+        // special case for all - process each one separately
+        result = setAllDevicesByName(target->context, target->request->requestedDeviceName);
+    } else {
+        // choose the requested audio device
+        result = setDevice(target->context, target->deviceID, typeRequested);
+        if (result == 0) {
+            printf("%s audio device set to \"%s\"\n", ASDeviceTypeName(typeRequested), target->printableDeviceName);
         }
-        free((void *)deviceUID_string);
     }
-    
-    CFRelease(deviceUID);
-    return "";
+    return result;
 }
 
-AudioDeviceID getRequestedDeviceIDFromUIDSubstring(char * requestedDeviceUID, ASDeviceType typeRequested) {
-    AudioObjectPropertyAddress propertyAddress = {kAudioHardwarePropertyDevices, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
-    UInt32 propertySize;
-    AudioDeviceID dev_array[64];
-    int numberOfDevices = 0;
+int runRequest(ASContext * context, const ASRequest * request, const char * appName) {
+    ASDeviceType typeRequested = request->typeRequested;
+    AudioDeviceID chosenDeviceID = kAudioDeviceUnknown;
+    char printableDeviceName[256];
+    int result = 0;
 
-    AudioObjectGetPropertyDataSize(kAudioObjectSystemObject, &propertyAddress, 0, NULL, &propertySize);
-    AudioObjectGetPropertyData(kAudioObjectSystemObject, &propertyAddress, 0, NULL, &propertySize, dev_array);
-    numberOfDevices = (propertySize / sizeof(AudioDeviceID));
+    // completions come first, they run on every keypress
+    if (request->function == kFunctionComplete || request->function == kFunctionCompleteUID) {
+        return completeDevices(context, request->completionPrefix, request->function == kFunctionCompleteUID ? kCompletionUID : kCompletionName,
+                               typeRequested, request->outputRequested);
+    }
+    if (request->function == kFunctionCompletionScript) {
+        return showCompletionScript(request->completionShell, appName);
+    }
 
-    for(int i = 0; i < numberOfDevices; ++i) {
+    if (request->function == kFunctionShowAll) {
         switch(typeRequested) {
             case kAudioTypeInput:
-                if (!isAnInputDevice(dev_array[i])) continue;
-                break;
-
             case kAudioTypeOutput:
-                if (!isAnOutputDevice(dev_array[i])) continue;
-                break;
-
+                return showAllDevices(context, typeRequested, request->outputRequested);
             case kAudioTypeSystemOutput:
-                if (getDeviceType(dev_array[i]) != kAudioTypeOutput) continue;
-                break;
-            default: break;
+                return showAllDevices(context, kAudioTypeOutput, request->outputRequested);
+            default:
+                // binary records carry their own type bits, so every device is written once
+                if (request->outputRequested == kFormatBinary) {
+                    return showAllDevices(context, kAudioTypeAll, request->outputRequested);
+                }
+                if (showAllDevices(context, kAudioTypeInput, request->outputRequested) != 0) {
+                    return 1;
+                }
+                return showAllDevices(context, kAudioTypeOutput, request->outputRequested);
         }
+    }
+    if (request->function == kFunctionShowCurrent) {
+        if (typeRequested == kAudioTypeUnknown) typeRequested = kAudioTypeOutput;
+        return showCurrentlySelectedDeviceID(context, typeRequested, request->outputRequested);
+    }
 
-        char deviceUID[256];
-        CFStringRef deviceUIDRef = NULL;
-        propertyAddress.mSelector = kAudioDevicePropertyDeviceUID;
-        propertyAddress.mScope = kAudioObjectPropertyScopeGlobal;
-        propertyAddress.mElement = dev_array[i];
-        propertySize = sizeof(deviceUIDRef);
-        AudioObjectGetPropertyData(dev_array[i], &propertyAddress, 0, NULL, &propertySize, &deviceUIDRef);
-        CFStringGetCString(deviceUIDRef, deviceUID, sizeof(deviceUID), CFStringGetSystemEncoding());
-        if (strstr(deviceUID, requestedDeviceUID) != NULL) {
-            return dev_array[i];
-        }
+    if (request->function == kFunctionListAggregates) {
+        showAggregateDevices(context, request->outputRequested);
+        return 0;
+    }
+    if (request->function == kFunctionDestroyAggregate) {
+        return destroyAggregateDevice(context, request->aggregateName);
+    }
+    if (request->function == kFunctionShowHistory) {
+        showHistory(request->outputRequested);
+        return 0;
+    }
+    if (request->function == kFunctionEnableHistory) {
+        return enableHistory();
+    }
+    if (request->function == kFunctionDisableHistory) {
+        return disableHistory();
+    }
+    if (request->function == kFunctionShowMetrics) {
+        showMetrics();
+        return 0;
+    }
+    if (request->function == kFunctionMeter) {
+        return meterDevice(context, request);
+    }
+    if (request->function == kFunctionMeasureLatency) {
+        return measureLatency(context, request);
     }
 
-    return kAudioDeviceUnknown;
-}
+    // switches made from here on are recorded as initiated by this command
+    setHistorySource(request->function);
 
-AudioDeviceID getCurrentlySelectedDeviceID(ASDeviceType typeRequested) {
-    AudioObjectPropertyAddress address;
-    address.mSelector = kAudioHardwarePropertyDefaultOutputDevice;
-    address.mScope = kAudioObjectPropertyScopeGlobal;
-    address.mElement = kAudioObjectPropertyElementMaster;
+    if (typeRequested == kAudioTypeUnknown) typeRequested = kAudioTypeOutput;
 
-    switch (typeRequested) {
-        case kAudioTypeInput:
-            address.mSelector = kAudioHardwarePropertyDefaultInputDevice;
-            break;
-        case kAudioTypeOutput:
-            address.mSelector = kAudioHardwarePropertyDefaultOutputDevice;
-            break;
-        case kAudioTypeSystemOutput:
-            address.mSelector = kAudioHardwarePropertyDefaultSystemOutputDevice;
-            break;
-        default:
-            break;
+    if (request->function == kFunctionMute) {
+        return muteDevice(context, typeRequested, request->muteRequested);
     }
 
-    AudioDeviceID deviceID = kAudioDeviceUnknown;
-    UInt32 dataSize = sizeof(AudioDeviceID);
-    OSStatus status = AudioObjectGetPropertyData(kAudioObjectSystemObject, &address, 0, NULL, &dataSize, &deviceID);
-    if (status != noErr) {
-        // handle error
-    }
+    if (request->function == kFunctionCreateAggregate) {
+        if (request->aggregateMembers == NULL || request->aggregateMembers[0] == '\0') {
+            printf("Please specify the members of the aggregate device with --members.\n");
+            showUsage(appName);
+            return 1;
+        }
+        result = createAggregateDevice(context, request->aggregateName, request->aggregateMembers, request->aggregateClock,
+                                       request->aggregateDrift, request->aggregateType, &chosenDeviceID);
+        if (result != 0 || !request->makeDefault) {
+            return result;
+        }
 
-    return deviceID;
-}
+        // the device has been published by now, so the refreshed snapshot contains it
+        if (typeRequested == kAudioTypeAll) {
+            const ASDeviceInfo * device = ASContextFindDevice(context, chosenDeviceID);
+            if (device == NULL || (!device->hasInput && !device->hasOutput)) {
+                printf("Could not read the streams of \"%s\".  The default device was not changed.\n", request->aggregateName);
+                return 1;
+            }
+            if (device->hasInput) result |= setDevice(context, chosenDeviceID, kAudioTypeInput);
+            if (device->hasOutput) result |= setDevice(context, chosenDeviceID, kAudioTypeOutput);
+        } else {
+            result = setDevice(context, chosenDeviceID, typeRequested);
+        }
+        if (result == 0) {
+            printf("%s audio device set to \"%s\"\n", ASDeviceTypeName(typeRequested), request->aggregateName);
+        }
+        return result;
+    }
 
-void getDeviceName(AudioDeviceID deviceID, char* deviceName) {
-    AudioObjectPropertyAddress address = {
-        kAudioDevicePropertyDeviceNameCFString,
-        kAudioObjectPropertyScopeGlobal,
-        kAudioObjectPropertyElementMaster
-    };
-    CFStringRef cfDeviceName = NULL;
-    UInt32 dataSize = sizeof(CFStringRef);
-    OSStatus result = AudioObjectGetPropertyData(deviceID, &address, 0, NULL, &dataSize, &cfDeviceName);
-    if (result == noErr && cfDeviceName != NULL) {
-        CFStringGetCString(cfDeviceName, deviceName, 256, kCFStringEncodingUTF8);
-        CFRelease(cfDeviceName);
+    if (request->function == kFunctionCycleNext) {
+        result = cycleNext(context, typeRequested);
+        return result;
     }
-}
 
-// returns kAudioTypeInput or kAudioTypeOutput
-ASDeviceType getDeviceType(AudioDeviceID deviceID) {
-    AudioObjectPropertyAddress address = {
-        kAudioDevicePropertyStreams,
-        kAudioObjectPropertyScopeGlobal,
-        kAudioObjectPropertyElementMaster
-    };
-    UInt32 dataSize = 0;
-    OSStatus result = AudioObjectGetPropertyDataSize(deviceID, &address, 0, NULL, &dataSize);
-    if (result == noErr && dataSize > 0) {
-        return kAudioTypeOutput;
+    if (request->function == kFunctionSetDeviceByID) {
+        chosenDeviceID = request->requestedDeviceID;
+        snprintf(printableDeviceName, sizeof(printableDeviceName), "Device with ID: %d", chosenDeviceID);
     }
-    address.mElement = kAudioObjectPropertyElementMaster + 1;
-    result = AudioObjectGetPropertyDataSize(deviceID, &address, 0, NULL, &dataSize);
-    if (result == noErr && dataSize > 0) {
-        return kAudioTypeInput;
+
+    if (request->function == kFunctionSetDeviceByName && typeRequested != kAudioTypeAll) {
+        // find the id of the requested device
+        if (findDevice(context, request->requestedDeviceName, NULL, typeRequested, &chosenDeviceID) != noErr) {
+            printf("Could not find an audio device named \"%s\" of type %s.  Nothing was changed.\n", request->requestedDeviceName, ASDeviceTypeName(typeRequested));
+            return 1;
+        }
+        strlcpy(printableDeviceName, request->requestedDeviceName, sizeof(printableDeviceName));
     }
-    return kAudioTypeUnknown;
-}
 
-bool isAnOutputDevice(AudioDeviceID deviceID) {
-    AudioObjectPropertyAddress propertyAddress = {kAudioDevicePropertyStreams, kAudioDevicePropertyScopeOutput, kAudioObjectPropertyElementMaster};
-    UInt32 dataSize = 0;
-    OSStatus result = AudioObjectGetPropertyDataSize(deviceID, &propertyAddress, 0, NULL, &dataSize);
-    if (result == noErr && dataSize > 0) {
-        return true;
+    if (request->function == kFunctionSetDeviceByUID) {
+        // find the id of the requested device
+        if (findDevice(context, NULL, request->requestedDeviceUID, typeRequested, &chosenDeviceID) != noErr) {
+            printf("Could not find an audio device with UID \"%s\" of type %s.  Nothing was changed.\n", request->requestedDeviceUID, ASDeviceTypeName(typeRequested));
+            return 1;
+        }
+        snprintf(printableDeviceName, sizeof(printableDeviceName), "Device with UID: %s", ASContextFindDevice(context, chosenDeviceID)->uid);
     }
-    return false;
-}
 
-bool isAnInputDevice(AudioDeviceID deviceID) {
-    AudioObjectPropertyAddress propertyAddress = {kAudioDevicePropertyStreams, kAudioDevicePropertyScopeInput, kAudioObjectPropertyElementMaster};
-    UInt32 dataSize = 0;
-    OSStatus result = AudioObjectGetPropertyDataSize(deviceID, &propertyAddress, sizeof(AudioClassDescription), kAudioDevicePropertyScopeInput, &dataSize);
-    if (result == noErr && dataSize > 0) {
-        return kAudioTypeInput;
+    // require a chose
+    if (!chosenDeviceID && !(typeRequested == kAudioTypeAll && request->function == kFunctionSetDeviceByName)) {
+        printf("Please specify audio device.\n");
+        showUsage(appName);
+        return 1;
     }
-    return false;
-}
 
-char *deviceTypeName(ASDeviceType device_type) {
-    switch(device_type) {
-        case kAudioTypeInput: return "input";
-        case kAudioTypeOutput: return "output";
-        case kAudioTypeSystemOutput: return "system";
-        case kAudioTypeAll: return "all";
-        default: return "unknown";
+    // concurrent set requests resolve to the last one queued
+    ASSetTarget target = {context, request, chosenDeviceID, printableDeviceName};
+    bool superseded = false;
+    result = coordinateSet(typeRequested, applySet, &target, &superseded);
+    if (superseded) {
+        printf("A newer request for the %s audio device is pending.  Nothing was changed.\n", ASDeviceTypeName(typeRequested));
     }
-    
-}
 
-void showCurrentlySelectedDeviceID(ASDeviceType typeRequested, ASOutputType outputRequested) {
-    AudioDeviceID currentDeviceID = kAudioDeviceUnknown;
-    char currentDeviceName[256];
-    
-    currentDeviceID = getCurrentlySelectedDeviceID(typeRequested);
-    getDeviceName(currentDeviceID, currentDeviceName);
+    return result;
+}
 
-    switch(outputRequested) {
-        case kFormatHuman:
-            printf("%s\n",currentDeviceName);
-            break;
-        case kFormatCLI:
-            printf("%s,%s,%u,%s\n",currentDeviceName,deviceTypeName(typeRequested),currentDeviceID,getDeviceUID(currentDeviceID));
+// counts a failed library call; lookups that found nothing are not HAL errors
+static void countFailure(OSStatus status) {
+    switch (status) {
+        case kASDeviceNotFoundError:
+        case kASAmbiguousDeviceError:
+            countLookupFailure();
             break;
-        case kFormatJSON:
-            printf("{\"name\": \"%s\", \"type\": \"%s\", \"id\": \"%u\", \"uid\": \"%s\"}\n",currentDeviceName,deviceTypeName(typeRequested),currentDeviceID,getDeviceUID(currentDeviceID));
+        case kASDeviceExistsError:
+        case kASNotAggregateError:
+        case kASInvalidArgumentError:
+        case kASOutOfMemoryError:
+        case kASTimeoutError:
             break;
         default:
+            countHALError(status);
             break;
     }
 }
 
-AudioDeviceID getRequestedDeviceID(char * requestedDeviceName, ASDeviceType typeRequested) {
-    AudioObjectPropertyAddress propertyAddress;
-    propertyAddress.mSelector = kAudioHardwarePropertyDevices;
-    propertyAddress.mScope = kAudioObjectPropertyScopeGlobal;
-    propertyAddress.mElement = kAudioObjectPropertyElementMaster;
-    
-    UInt32 propertySize;
-    AudioDeviceID dev_array[64];
-    int numberOfDevices = 0;
-    char deviceName[256];
-    
-    OSStatus status = AudioObjectGetPropertyDataSize(kAudioObjectSystemObject, &propertyAddress, 0, NULL, &propertySize);
+// reads the device list, timed as enumeration
+static OSStatus refreshDevices(ASContext * context) {
+    UInt64 startTime = metricsNow();
+    OSStatus status = ASContextRefresh(context);
+    observeDuration(kHistogramEnumeration, startTime);
     if (status != noErr) {
-        printf("Error getting size of property data: %d\n", status);
-        return kAudioDeviceUnknown;
+        countFailure(status);
     }
-    
-    status = AudioObjectGetPropertyData(kAudioObjectSystemObject, &propertyAddress, 0, NULL, &propertySize, dev_array);
+    return status;
+}
+
+// finds a device by exact name or by uid substring, timed as a lookup
+OSStatus findDevice(ASContext * context, const char * name, const char * uid, ASDeviceType typeRequested, AudioDeviceID * deviceID) {
+    OSStatus status = refreshDevices(context);
     if (status != noErr) {
-        printf("Error getting property data: %d\n", status);
-        return kAudioDeviceUnknown;
+        return status;
     }
-    
-    numberOfDevices = (propertySize / sizeof(AudioDeviceID));
-    for(int i = 0; i < numberOfDevices; ++i) {
-        switch(typeRequested) {
-            case kAudioTypeInput:
-                if (!isAnInputDevice(dev_array[i])) continue;
-                break;
-
-            case kAudioTypeOutput:
-                if (!isAnOutputDevice(dev_array[i])) continue;
-                break;
 
-            case kAudioTypeSystemOutput:
-                if (getDeviceType(dev_array[i]) != kAudioTypeOutput) continue;
-                break;
-            default: break;
-        }
-        
-        getDeviceName(dev_array[i], deviceName);
-        if (strcmp(requestedDeviceName, deviceName) == 0) {
-            return dev_array[i];
-        }
+    UInt64 startTime = metricsNow();
+    if (name != NULL) {
+        status = ASFindDeviceByName(context, name, typeRequested, deviceID);
+    } else {
+        status = ASFindDeviceByUIDSubstring(context, uid, typeRequested, deviceID);
     }
-    
-    return kAudioDeviceUnknown;
+    observeDuration(kHistogramLookup, startTime);
+    if (status != noErr) {
+        countFailure(status);
+    }
+    return status;
 }
 
-AudioDeviceID getNextDeviceID(AudioDeviceID currentDeviceID, ASDeviceType typeRequested) {
-    AudioObjectPropertyAddress addr;
-    AudioDeviceID dev_array[64];
-    int numberOfDevices = 0;
-    AudioDeviceID first_dev = kAudioDeviceUnknown;
-    int found = -1;
+// CoreServices is only needed to describe errors, so it is loaded on first use
+// instead of being linked and paying for it on every start
+const char * statusErrorString(OSStatus status) {
+    static const char * (*getErrorString)(OSStatus) = NULL;
+    static char fallback[16];
 
-    addr.mSelector = kAudioHardwarePropertyDevices;
-    addr.mScope = kAudioObjectPropertyScopeGlobal;
-    addr.mElement = kAudioObjectPropertyElementMaster;
-    UInt32 propertySize = 0;
-    OSStatus err = AudioObjectGetPropertyDataSize(kAudioObjectSystemObject, &addr, 0, NULL, &propertySize);
-    if (err != noErr) {
-        return kAudioDeviceUnknown;
+    if (getErrorString == NULL) {
+        void * coreServices = dlopen("/System/Library/Frameworks/CoreServices.framework/CoreServices", RTLD_LAZY | RTLD_LOCAL);
+        if (coreServices != NULL) {
+            getErrorString = (const char * (*)(OSStatus))dlsym(coreServices, "GetMacOSStatusErrorString");
+        }
     }
-
-    err = AudioObjectGetPropertyData(kAudioObjectSystemObject, &addr, 0, NULL, &propertySize, dev_array);
-    if (err != noErr) {
-        return kAudioDeviceUnknown;
+    if (getErrorString != NULL) {
+        return getErrorString(status);
     }
-    numberOfDevices = (propertySize / sizeof(AudioDeviceID));
-
-    for(int i = 0; i < numberOfDevices; ++i) {
-        switch(typeRequested) {
-            case kAudioTypeInput:
-                if (!isAnInputDevice(dev_array[i])) continue;
-                break;
 
-            case kAudioTypeOutput:
-                if (!isAnOutputDevice(dev_array[i])) continue;
-                break;
-
-            case kAudioTypeSystemOutput:
-                if (getDeviceType(dev_array[i]) != kAudioTypeOutput) continue;
-                break;
+    // most HAL errors are four character codes, the classic ones are small negative numbers
+    UInt32 code = (UInt32)status;
+    if (isprint((code >> 24) & 0xff) && isprint((code >> 16) & 0xff) && isprint((code >> 8) & 0xff) && isprint(code & 0xff)) {
+        snprintf(fallback, sizeof(fallback), "'%c%c%c%c'", (code >> 24) & 0xff, (code >> 16) & 0xff, (code >> 8) & 0xff, code & 0xff);
+    } else {
+        snprintf(fallback, sizeof(fallback), "%d", (int)status);
+    }
+    return fallback;
+}
 
-            default: 
-                break;
-        }
+// binary output must stay parseable, so its errors go to stderr
+static FILE * errorStream(ASOutputType outputRequested) {
+    return outputRequested == kFormatBinary ? stderr : stdout;
+}
 
-        if (first_dev == kAudioDeviceUnknown) {
-            first_dev = dev_array[i];
-        }
-        if (found >= 0) {
-            return dev_array[i];
-        }
-        if (dev_array[i] == currentDeviceID) {
-            found = i;
-        }
+// the type bits are the device's own, the role it was asked for is a field
+static int showCurrentDeviceBinary(ASContext * context, AudioDeviceID deviceID, const char * deviceName, ASDeviceType typeRequested) {
+    ASBinaryWriter writer;
+    char * deviceUID = NULL;
+    bool hasInput = false, hasOutput = false, isAggregate = false;
+    uint8_t role = typeRequested == kAudioTypeInput ? kBinaryRoleInput
+                 : typeRequested == kAudioTypeSystemOutput ? kBinaryRoleSystem : kBinaryRoleOutput;
+
+    OSStatus status = ASCopyDeviceUID(context, deviceID, &deviceUID);
+    if (status == noErr) {
+        status = ASGetDeviceCapabilities(context, deviceID, &hasInput, &hasOutput, &isAggregate);
+    }
+    if (status != noErr) {
+        countFailure(status);
+        fprintf(stderr, "Could not read the current audio device of type %s.\n", ASDeviceTypeName(typeRequested));
+        free(deviceUID);
+        return 1;
     }
 
-    return first_dev;
-}
+    binaryWriterInit(&writer);
+    binaryBeginDevice(&writer, deviceID, (hasInput ? kBinaryTypeInput : 0) | (hasOutput ? kBinaryTypeOutput : 0) | (isAggregate ? kBinaryTypeAggregate : 0),
+                      deviceName, deviceUID);
+    binaryAppendField(&writer, kBinaryFieldDefault, &role, sizeof(role));
+    binaryEndDevice(&writer);
+    free(deviceUID);
 
-int setDevice(AudioDeviceID newDeviceID, ASDeviceType typeRequested) {
-    return setOneDevice(newDeviceID, typeRequested);
+    if (binaryWriterFlush(&writer, stdout) != 0) {
+        fprintf(stderr, "Could not write the current audio device.\n");
+        return 1;
+    }
+    return 0;
 }
 
-int setOneDevice(AudioDeviceID newDeviceID, ASDeviceType typeRequested) {
-    AudioObjectPropertyAddress addr;
-    UInt32 propertySize = sizeof(UInt32);
-    OSStatus status;
+int showCurrentlySelectedDeviceID(ASContext * context, ASDeviceType typeRequested, ASOutputType outputRequested) {
+    AudioDeviceID currentDeviceID = kAudioDeviceUnknown;
+    char * currentDeviceName = NULL;
+    char * currentDeviceUID = NULL;
+    int result = 0;
 
-    addr.mScope = kAudioObjectPropertyScopeGlobal;
-    addr.mElement = kAudioObjectPropertyElementMaster;
+    // only the current device is queried, the device list is never read
+    OSStatus status = ASGetDefaultDevice(context, typeRequested, &currentDeviceID);
+    if (status == noErr) {
+        status = ASCopyDeviceName(context, currentDeviceID, &currentDeviceName);
+    }
+    if (status == noErr && (outputRequested == kFormatCLI || outputRequested == kFormatJSON)) {
+        status = ASCopyDeviceUID(context, currentDeviceID, &currentDeviceUID);
+    }
+    if (status != noErr) {
+        countFailure(status);
+        fprintf(errorStream(outputRequested), "Could not find current audio device of type %s.\n", ASDeviceTypeName(typeRequested));
+        free(currentDeviceName);
+        return 1;
+    }
 
-    switch(typeRequested) {
-        case kAudioTypeInput:
-            addr.mSelector = kAudioHardwarePropertyDefaultInputDevice;
+    switch(outputRequested) {
+        case kFormatHuman:
+            printf("%s\n",currentDeviceName);
             break;
-        case kAudioTypeOutput:
-            addr.mSelector = kAudioHardwarePropertyDefaultOutputDevice;
+        case kFormatCLI:
+            printf("%s,%s,%u,%s\n",currentDeviceName,ASDeviceTypeName(typeRequested),currentDeviceID,currentDeviceUID);
+            break;
+        case kFormatJSON:
+            printf("{\"name\": \"%s\", \"type\": \"%s\", \"id\": \"%u\", \"uid\": \"%s\"}\n",currentDeviceName,ASDeviceTypeName(typeRequested),currentDeviceID,currentDeviceUID);
             break;
-        case kAudioTypeSystemOutput:
-            addr.mSelector = kAudioHardwarePropertyDefaultSystemOutputDevice;
+        case kFormatBinary:
+            result = showCurrentDeviceBinary(context, currentDeviceID, currentDeviceName, typeRequested);
             break;
         default:
-            addr.mSelector = kAudioHardwarePropertyDefaultOutputDevice;
             break;
     }
-    status = AudioObjectSetPropertyData(kAudioObjectSystemObject, &addr, 0, NULL, propertySize, &newDeviceID);
-    if(status != noErr) {
-        printf("Failed to set %s", deviceTypeName(typeRequested));
+    free(currentDeviceName);
+    free(currentDeviceUID);
+    return result;
+}
+
+int setDevice(ASContext * context, AudioDeviceID newDeviceID, ASDeviceType typeRequested) {
+    AudioDeviceID oldDeviceID = kAudioDeviceUnknown;
+
+    // the previous device is only needed for the history
+    if (isHistoryEnabled()) {
+        ASGetDefaultDevice(context, typeRequested, &oldDeviceID);
+    }
+
+    UInt64 startTime = metricsNow();
+    OSStatus status = ASSetDefaultDevice(context, typeRequested, newDeviceID);
+    observeDuration(kHistogramSwitch, startTime);
+    if (status != noErr) {
+        countFailure(status);
+        printf("Failed to set %s audio device. Error: %d (%s)\n", ASDeviceTypeName(typeRequested), status, statusErrorString(status));
+        return 1;
     }
 
+    countSwitch(typeRequested);
+    if (oldDeviceID != kAudioDeviceUnknown && oldDeviceID != newDeviceID) {
+        recordDeviceChange(context, typeRequested, oldDeviceID, newDeviceID);
+    }
     return 0;
 }
 
-int setAllDevicesByName(char * requestedDeviceName) {
-    int result;
+int setAllDevicesByName(ASContext * context, const char * requestedDeviceName) {
+    const ASDeviceType types[] = {kAudioTypeInput, kAudioTypeOutput, kAudioTypeSystemOutput};
     bool anyStatusError = false;
     AudioDeviceID newDeviceID;
-    
-    // input
-    newDeviceID = getRequestedDeviceID(requestedDeviceName, kAudioTypeInput);
-    if (newDeviceID != nil) {
-        result = setOneDevice(newDeviceID, kAudioTypeInput);
-        if (result != 0) {
-            anyStatusError = true;
-        } else {
-            printf("%s audio device set to \"%s\"\n", deviceTypeName(kAudioTypeInput), requestedDeviceName);
-        }
-    }
 
-    // output
-    newDeviceID = getRequestedDeviceID(requestedDeviceName, kAudioTypeOutput);
-    if (newDeviceID != nil) {
-        result = setOneDevice(newDeviceID, kAudioTypeOutput);
-        if (result != 0) {
-            anyStatusError = true;
-        } else {
-            printf("%s audio device set to \"%s\"\n", deviceTypeName(kAudioTypeOutput), requestedDeviceName);
-        }
-    }
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+        if (findDevice(context, requestedDeviceName, NULL, types[i], &newDeviceID) != noErr) continue;
 
-    // system
-    newDeviceID = getRequestedDeviceID(requestedDeviceName, kAudioTypeSystemOutput);
-    if (newDeviceID != nil) {
-        result = setOneDevice(newDeviceID, kAudioTypeSystemOutput);
-        if (result != 0) {
+        if (setDevice(context, newDeviceID, types[i]) != 0) {
             anyStatusError = true;
         } else {
-            printf("%s audio device set to \"%s\"\n", deviceTypeName(kAudioTypeSystemOutput), requestedDeviceName);
+            printf("%s audio device set to \"%s\"\n", ASDeviceTypeName(types[i]), requestedDeviceName);
         }
     }
 
@@ -636,163 +696,417 @@ int setAllDevicesByName(char * requestedDeviceName) {
     return 0;
 }
 
-int cycleNext(ASDeviceType typeRequested) {
-    int result;
+// applies the coalesced presses; userData is the context
+static int applyCycle(ASDeviceType typeRequested, UInt32 steps, void * userData) {
+    ASContext * context = (ASContext *)userData;
+    int result = 0;
     bool anyStatusError = false;
+
     if (typeRequested == kAudioTypeAll) {
-        result = cycleNextForOneDevice(kAudioTypeInput);
+        result = cycleNextForOneDevice(context, kAudioTypeInput, steps);
         if (result != 0) {
             anyStatusError = true;
         }
-        result = cycleNextForOneDevice(kAudioTypeOutput);
+        result = cycleNextForOneDevice(context, kAudioTypeOutput, steps);
         if (result != 0) {
             anyStatusError = true;
         }
-        result = cycleNextForOneDevice(kAudioTypeSystemOutput);
+        result = cycleNextForOneDevice(context, kAudioTypeSystemOutput, steps);
         if (result != 0) {
             anyStatusError = true;
         }
-
-        if (anyStatusError) {
-            return 1;
-        }
-        return 0;
+        result = anyStatusError ? 1 : 0;
 
     } else {
-        return cycleNextForOneDevice(typeRequested);
+        result = cycleNextForOneDevice(context, typeRequested, steps);
     }
+    return result;
 }
 
-int cycleNextForOneDevice(ASDeviceType typeRequested) {
-    char requestedDeviceName[256];
+int cycleNext(ASContext * context, ASDeviceType typeRequested) {
+    // presses from concurrent invocations are coalesced into a single switch
+    return coordinateCycle(typeRequested, applyCycle, context);
+}
+
+int cycleNextForOneDevice(ASContext * context, ASDeviceType typeRequested, UInt32 steps) {
+    AudioDeviceID chosenDeviceID = kAudioDeviceUnknown;
 
     // get current device of requested type
-    AudioDeviceID chosenDeviceID = getCurrentlySelectedDeviceID(typeRequested);
-    if (chosenDeviceID == kAudioDeviceUnknown) {
-        printf("Could not find current audio device of type %s.  Nothing was changed.\n", deviceTypeName(typeRequested));
+    OSStatus status = ASGetDefaultDevice(context, typeRequested, &chosenDeviceID);
+    if (status != noErr) {
+        countFailure(status);
+        printf("Could not find current audio device of type %s.  Nothing was changed.\n", ASDeviceTypeName(typeRequested));
         return 1;
     }
 
-    // find next device to current device
-    chosenDeviceID = getNextDeviceID(chosenDeviceID, typeRequested);
-    if (chosenDeviceID == kAudioDeviceUnknown) {
-        printf("Could not find next audio device of type %s.  Nothing was changed.\n", deviceTypeName(typeRequested));
+    // find the device the given number of steps after the current device
+    status = refreshDevices(context);
+    if (status == noErr) {
+        status = ASGetNextDevice(context, chosenDeviceID, typeRequested, steps, &chosenDeviceID);
+    }
+    if (status != noErr) {
+        countFailure(status);
+        printf("Could not find next audio device of type %s.  Nothing was changed.\n", ASDeviceTypeName(typeRequested));
         return 1;
     }
     
     // choose the requested audio device
-    int result = setDevice(chosenDeviceID, typeRequested);
-    if (result == 0) {
-        getDeviceName(chosenDeviceID, requestedDeviceName);
-        printf("%s audio device set to \"%s\"\n", deviceTypeName(typeRequested), requestedDeviceName);
+    int result = setDevice(context, chosenDeviceID, typeRequested);
+    char * chosenDeviceName = NULL;
+    if (result == 0 && ASCopyDeviceName(context, chosenDeviceID, &chosenDeviceName) == noErr) {
+        printf("%s audio device set to \"%s\"\n", ASDeviceTypeName(typeRequested), chosenDeviceName);
+        free(chosenDeviceName);
     }
     return result;
 
 }
 
-
-OSStatus setMute(ASDeviceType typeRequested, ASMuteType muteRequested) {
+static int muteOneDevice(ASContext * context, ASDeviceType typeRequested, ASMuteType muteRequested) {
     AudioDeviceID currentDeviceID = kAudioDeviceUnknown;
-    char currentDeviceName[256];
-    
-    currentDeviceID = getCurrentlySelectedDeviceID(typeRequested);
-    getDeviceName(currentDeviceID, currentDeviceName);
-    
-    UInt32 scope = kAudioObjectPropertyScopeInput;
-    
+    char * currentDeviceName = NULL;
+    UInt32 muted = 0;
+
+    OSStatus status = ASSetMute(context, typeRequested, muteRequested, &muted);
+    if (status != noErr) {
+        countFailure(status);
+        printf("Failed setting mute state for %s. Error: %d (%s)\n", ASDeviceTypeName(typeRequested), status, statusErrorString(status));
+        return 1;
+    }
+
+    if (ASGetDefaultDevice(context, typeRequested, &currentDeviceID) == noErr && ASCopyDeviceName(context, currentDeviceID, &currentDeviceName) == noErr) {
+        printf("Device %s set to %s\n", currentDeviceName, muted ? "muted": "unmuted");
+        free(currentDeviceName);
+    }
+    return 0;
+}
+
+int muteDevice(ASContext * context, ASDeviceType typeRequested, ASMuteType muteRequested) {
+    int result = 0;
+
     switch(typeRequested) {
-        case kAudioTypeInput:
-            scope = kAudioObjectPropertyScopeInput;
-            break;
+        case kAudioTypeInput: 
         case kAudioTypeOutput:
-            scope = kAudioObjectPropertyScopeOutput;
-            break;
-        case kAudioTypeSystemOutput:
-            scope = kAudioObjectPropertyScopeGlobal;
-            break;
+            return muteOneDevice(context, typeRequested, muteRequested);
+        case kAudioTypeAll:
+            result |= muteOneDevice(context, kAudioTypeInput, muteRequested);
+            result |= muteOneDevice(context, kAudioTypeOutput, muteRequested);
+            return result;
+        default:
+            printf("audio device \"%s\" may not be muted\n", ASDeviceTypeName(typeRequested));
+            return 1;
     }
+}
 
-    AudioObjectPropertyAddress propertyAddress = {
-        .mSelector  = kAudioDevicePropertyMute,
-        .mScope     = scope,
-        .mElement   = kAudioObjectPropertyElementMain,
-    };
+// meters the input device named with -s, -u or -i without switching to it
+int meterDevice(ASContext * context, const ASRequest * request) {
+    AudioDeviceID deviceID = request->requestedDeviceID;
+    OSStatus status = noErr;
+
+    if (request->requestedDeviceName != NULL) {
+        status = findDevice(context, request->requestedDeviceName, NULL, kAudioTypeInput, &deviceID);
+    } else if (request->requestedDeviceUID != NULL) {
+        status = findDevice(context, NULL, request->requestedDeviceUID, kAudioTypeInput, &deviceID);
+    } else if (deviceID == kAudioDeviceUnknown) {
+        status = ASGetDefaultDevice(context, kAudioTypeInput, &deviceID);
+    }
+    if (status != noErr) {
+        printf("Could not find the input device to meter. Error: %d (%s)\n", status, statusErrorString(status));
+        return 1;
+    }
+    return runMeter(context, deviceID, request->meterInterval, request->outputRequested);
+}
+
+// the requested device by name or uid, or the current default device
+static OSStatus findLatencyDevice(ASContext * context, const char * requested, ASDeviceType typeRequested, AudioDeviceID * deviceID) {
+    if (requested == NULL) {
+        return ASGetDefaultDevice(context, typeRequested, deviceID);
+    }
+    OSStatus status = refreshDevices(context);
+    if (status == noErr) {
+        status = ASFindDeviceByName(context, requested, typeRequested, deviceID);
+    }
+    if (status == kASDeviceNotFoundError) {
+        status = ASFindDeviceByUIDSubstring(context, requested, typeRequested, deviceID);
+    }
+    if (status != noErr) {
+        countFailure(status);
+    }
+    return status;
+}
 
-    UInt32 muted = (UInt32)muteRequested;
-    UInt32 propertySize = sizeof(muted);
+int measureLatency(ASContext * context, const ASRequest * request) {
+    AudioDeviceID outputDeviceID = kAudioDeviceUnknown;
+    AudioDeviceID inputDeviceID = kAudioDeviceUnknown;
 
-    OSStatus status;
-    if (muteRequested == kToggleMute) {
-        UInt32 dataSize;
-        status = AudioObjectGetPropertyDataSize(currentDeviceID, &propertyAddress, 0, NULL, &dataSize);
-        if (status != noErr) {
-            return status;
-        }
-        status = AudioObjectGetPropertyData(currentDeviceID, &propertyAddress, 0, NULL, &propertySize, &muted);
-        if (status != noErr) {
-            return status;
+    OSStatus status = findLatencyDevice(context, request->latencyOutput, kAudioTypeOutput, &outputDeviceID);
+    if (status != noErr) {
+        printf("Could not find the output device to measure. Error: %d (%s)\n", status, statusErrorString(status));
+        return 1;
+    }
+    status = findLatencyDevice(context, request->latencyInput, kAudioTypeInput, &inputDeviceID);
+    if (status != noErr) {
+        printf("Could not find the input device to measure. Error: %d (%s)\n", status, statusErrorString(status));
+        return 1;
+    }
+    return runLatencyMeasurement(context, outputDeviceID, inputDeviceID, request->outputRequested);
+}
+
+// joins the members of an aggregate device into a caller owned string, or
+// into a JSON array that is [] when the members cannot be read
+static char * copyAggregateMembers(ASContext * context, AudioDeviceID deviceID, const char * separator, bool json) {
+    char ** members = NULL;
+    UInt32 memberCount = 0;
+    const char * quote = json ? "\"" : "";
+    size_t length = json ? 3 : 1;
+
+    if (ASCopyAggregateMembers(context, deviceID, &members, &memberCount) != noErr) {
+        members = NULL;
+        memberCount = 0;
+    }
+    for (UInt32 i = 0; i < memberCount; ++i) {
+        length += strlen(members[i]) + strlen(separator) + 2 * strlen(quote);
+    }
+
+    char * joined = (char *)malloc(length);
+    if (joined != NULL) {
+        joined[0] = '\0';
+        if (json) strlcat(joined, "[", length);
+        for (UInt32 i = 0; i < memberCount; ++i) {
+            if (i > 0) strlcat(joined, separator, length);
+            strlcat(joined, quote, length);
+            strlcat(joined, members[i], length);
+            strlcat(joined, quote, length);
         }
-        muted = !muted;
+        if (json) strlcat(joined, "]", length);
     }
+    ASFreeStrings(members, memberCount);
+    return joined;
+}
 
-    printf("Setting device %s to %s\n", currentDeviceName, muted ? "muted": "unmuted");
+// writes all matching devices as one binary stream
+static int showDevicesBinary(ASContext * context, const ASDeviceInfo * devices, UInt32 numberOfDevices, ASDeviceType typeRequested) {
+    ASBinaryWriter writer;
+    binaryWriterInit(&writer);
+
+    for (UInt32 i = 0; i < numberOfDevices; ++i) {
+        const ASDeviceInfo * device = &devices[i];
+        if (!ASDeviceMatchesType(device, typeRequested)) continue;
+
+        uint8_t typeBits = (device->hasInput ? kBinaryTypeInput : 0) | (device->hasOutput ? kBinaryTypeOutput : 0)
+                           | (device->isAggregate ? kBinaryTypeAggregate : 0);
+        binaryBeginDevice(&writer, device->deviceID, typeBits, device->name, device->uid);
+
+        char ** members = NULL;
+        UInt32 memberCount = 0;
+        if (device->isAggregate && ASCopyAggregateMembers(context, device->deviceID, &members, &memberCount) == noErr) {
+            for (UInt32 m = 0; m < memberCount; ++m) {
+                size_t length = strlen(members[m]);
+                binaryAppendField(&writer, kBinaryFieldMember, members[m], (uint16_t)(length > UINT16_MAX ? UINT16_MAX : length));
+            }
+            ASFreeStrings(members, memberCount);
+        }
+        binaryEndDevice(&writer);
+    }
 
-    return AudioObjectSetPropertyData(currentDeviceID, &propertyAddress, 0, NULL, propertySize, &muted);
+    if (binaryWriterFlush(&writer, stdout) != 0) {
+        fprintf(stderr, "Could not write the audio devices.\n");
+        return 1;
+    }
+    return 0;
 }
 
-void showAllDevices(ASDeviceType typeRequested, ASOutputType outputRequested) {
-    UInt32 propertySize;
-    AudioObjectPropertyAddress propertyAddress;
-    AudioDeviceID dev_array[64];
-    int numberOfDevices = 0;
-    ASDeviceType device_type;
-    char deviceName[256];
+int showAllDevices(ASContext * context, ASDeviceType typeRequested, ASOutputType outputRequested) {
+    const ASDeviceInfo * devices = NULL;
+    UInt32 numberOfDevices = 0;
+
+    if (refreshDevices(context) != noErr || ASContextGetDevices(context, &devices, &numberOfDevices) != noErr) {
+        fprintf(errorStream(outputRequested), "Could not read the audio devices.\n");
+        return 1;
+    }
+    if (outputRequested == kFormatBinary) {
+        return showDevicesBinary(context, devices, numberOfDevices, typeRequested);
+    }
 
-    propertyAddress.mSelector = kAudioHardwarePropertyDevices;
-    propertyAddress.mScope = kAudioObjectPropertyScopeGlobal;
-    propertyAddress.mElement = kAudioObjectPropertyElementMaster;
+    for (UInt32 i = 0; i < numberOfDevices; ++i) {
+        const ASDeviceInfo * device = &devices[i];
+        if (!ASDeviceMatchesType(device, typeRequested)) continue;
 
-    propertySize = 0;
-    AudioObjectGetPropertyDataSize(kAudioObjectSystemObject, &propertyAddress, 0, NULL, &propertySize);
-    numberOfDevices = propertySize / sizeof(AudioDeviceID);
+        const char * deviceType = ASDeviceTypeName(typeRequested == kAudioTypeSystemOutput ? device->type : typeRequested);
 
-    AudioObjectGetPropertyData(kAudioObjectSystemObject, &propertyAddress, 0, NULL, &propertySize, dev_array);
+        // aggregate devices additionally list their members
+        char * members = NULL;
+        if (outputRequested != kFormatHuman && device->isAggregate) {
+            members = copyAggregateMembers(context, device->deviceID, outputRequested == kFormatJSON ? ", " : "|", outputRequested == kFormatJSON);
+        }
 
-    for (int i = 0; i < numberOfDevices; ++i) {
-        switch (typeRequested) {
-            case kAudioTypeInput:
-                if (!isAnInputDevice(dev_array[i]))
-                    continue;
-                device_type = kAudioTypeInput;
+        switch (outputRequested) {
+            case kFormatHuman:
+                printf("%s\n", device->name);
                 break;
-            case kAudioTypeOutput:
-                if (!isAnOutputDevice(dev_array[i]))
-                    continue;
-                device_type = kAudioTypeOutput;
+            case kFormatCLI:
+                if (members != NULL) {
+                    printf("%s,%s,%u,%s,%s\n", device->name, deviceType, device->deviceID, device->uid, members);
+                } else {
+                    printf("%s,%s,%u,%s\n", device->name, deviceType, device->deviceID, device->uid);
+                }
                 break;
-            case kAudioTypeSystemOutput:
-                device_type = getDeviceType(dev_array[i]);
-                if (device_type != kAudioTypeOutput)
-                    continue;
+            case kFormatJSON:
+                if (members != NULL) {
+                    printf("{\"name\": \"%s\", \"type\": \"%s\", \"id\": \"%u\", \"uid\": \"%s\", \"members\": %s}\n", device->name, deviceType, device->deviceID, device->uid, members);
+                } else {
+                    printf("{\"name\": \"%s\", \"type\": \"%s\", \"id\": \"%u\", \"uid\": \"%s\"}\n", device->name, deviceType, device->deviceID, device->uid);
+                }
                 break;
             default:
                 break;
         }
+        free(members);
+    }
+    return 0;
+}
+
+// splits a comma separated list into a caller owned array of trimmed items
+static char ** splitList(const char * list, UInt32 * count) {
+    char * copy = strdup(list ? list : "");
+    char * context = NULL;
+    UInt32 capacity = 1;
+
+    for (const char * p = copy; p && *p; ++p) {
+        if (*p == ',') capacity++;
+    }
+    char ** items = (char **)calloc(capacity, sizeof(char *));
+    *count = 0;
+    if (copy == NULL || items == NULL) {
+        free(copy);
+        free(items);
+        return NULL;
+    }
+    for (char * item = strtok_r(copy, ",", &context); item != NULL; item = strtok_r(NULL, ",", &context)) {
+        while (*item == ' ') item++;
+        items[(*count)++] = strdup(item);
+    }
+    free(copy);
+    return items;
+}
+
+int createAggregateDevice(ASContext * context, const char * aggregateName, const char * memberList, const char * clockMember,
+                          const char * driftList, ASAggregateType aggregateType, AudioDeviceID * newDeviceID) {
+    UInt32 memberCount = 0;
+    UInt32 driftCount = 0;
+    bool driftAll = (driftList != NULL && strcmp(driftList, "all") == 0);
+
+    if (refreshDevices(context) != noErr) {
+        printf("Could not read the audio devices.  Nothing was changed.\n");
+        return 1;
+    }
+
+    char ** members = splitList(memberList, &memberCount);
+    char ** driftMembers = splitList(driftAll ? NULL : driftList, &driftCount);
+    OSStatus status = ASCreateAggregateDevice(context, aggregateName, (const char * const *)members, memberCount, clockMember,
+                                              (const char * const *)driftMembers, driftCount, driftAll, aggregateType, newDeviceID);
+
+    // find the member that could not be resolved for the message
+    const char * missing = clockMember;
+    AudioDeviceID memberDeviceID;
+    for (UInt32 i = 0; status == kASDeviceNotFoundError && i < memberCount; ++i) {
+        if (ASFindDeviceByNameOrUID(context, members[i], &memberDeviceID) != noErr) {
+            missing = members[i];
+            break;
+        }
+    }
+
+    switch (status) {
+        case noErr:
+            printf("%s device \"%s\" created with id %u\n", aggregateType == kAggregateMultiOutput ? "multi-output" : "aggregate", aggregateName, *newDeviceID);
+            break;
+        case kASDeviceExistsError:
+            printf("An audio device named \"%s\" already exists.  Nothing was changed.\n", aggregateName);
+            break;
+        case kASDeviceNotFoundError:
+            printf("Could not find an audio device named or with UID \"%s\".  Nothing was changed.\n", missing ? missing : "");
+            break;
+        case kASInvalidArgumentError:
+            printf("The clock source \"%s\" must be one of the members.  Nothing was changed.\n", clockMember ? clockMember : "");
+            break;
+        case kASTimeoutError:
+            printf("The %s device \"%s\" was created but did not become available.\n", aggregateType == kAggregateMultiOutput ? "multi-output" : "aggregate", aggregateName);
+            break;
+        default:
+            printf("Failed to create aggregate device. Error: %d (%s)\n", status, statusErrorString(status));
+            break;
+    }
+    if (status != noErr) {
+        countFailure(status);
+    }
+
+    ASFreeStrings(members, memberCount);
+    ASFreeStrings(driftMembers, driftCount);
+    return (status == noErr) ? 0 : 1;
+}
+
+int destroyAggregateDevice(ASContext * context, const char * requested) {
+    AudioDeviceID deviceID = kAudioDeviceUnknown;
+
+    OSStatus status = refreshDevices(context);
+    if (status == noErr) {
+        status = ASFindDeviceExactly(context, requested, &deviceID);
+    }
+    if (status == noErr) {
+        status = ASDestroyAggregateDevice(context, deviceID);
+    }
+
+    switch (status) {
+        case noErr:
+            printf("aggregate device \"%s\" destroyed\n", requested);
+            return 0;
+        case kASDeviceNotFoundError:
+            printf("Could not find an audio device named or with UID \"%s\".  Nothing was changed.\n", requested);
+            break;
+        case kASAmbiguousDeviceError:
+            printf("More than one audio device is named \"%s\".  Use its UID instead.  Nothing was changed.\n", requested);
+            break;
+        case kASNotAggregateError:
+            printf("Audio device \"%s\" is not an aggregate device.  Nothing was changed.\n", requested);
+            break;
+        default:
+            printf("Failed to destroy aggregate device. Error: %d (%s)\n", status, statusErrorString(status));
+            break;
+    }
+    countFailure(status);
+    return 1;
+}
+
+void showAggregateDevices(ASContext * context, ASOutputType outputRequested) {
+    const ASDeviceInfo * devices = NULL;
+    UInt32 numberOfDevices = 0;
+
+    if (refreshDevices(context) != noErr || ASContextGetDevices(context, &devices, &numberOfDevices) != noErr) {
+        printf("Could not read the audio devices.\n");
+        return;
+    }
 
-        getDeviceName(dev_array[i], deviceName);
+    for (UInt32 i = 0; i < numberOfDevices; ++i) {
+        const ASDeviceInfo * device = &devices[i];
+        if (!device->isAggregate) continue;
 
+        char * members;
         switch (outputRequested) {
             case kFormatHuman:
-                printf("%s\n", deviceName);
+                members = copyAggregateMembers(context, device->deviceID, ", ", false);
+                printf("%s: %s\n", device->name, members);
                 break;
             case kFormatCLI:
-                printf("%s,%s,%u,%s\n", deviceName, deviceTypeName(device_type), dev_array[i], getDeviceUID(dev_array[i]));
+                members = copyAggregateMembers(context, device->deviceID, "|", false);
+                printf("%s,%u,%s,%s\n", device->name, device->deviceID, device->uid, members);
                 break;
             case kFormatJSON:
-                printf("{\"name\": \"%s\", \"type\": \"%s\", \"id\": \"%u\", \"uid\": \"%s\"}\n", deviceName, deviceTypeName(device_type), dev_array[i], getDeviceUID(dev_array[i]));
+                members = copyAggregateMembers(context, device->deviceID, ", ", true);
+                printf("{\"name\": \"%s\", \"id\": \"%u\", \"uid\": \"%s\", \"members\": %s}\n", device->name, device->deviceID, device->uid, members);
                 break;
             default:
+                members = NULL;
                 break;
         }
+        free(members);
     }
 }
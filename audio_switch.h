@@ -29,33 +29,21 @@ OTHER DEALINGS IN THE SOFTWARE.
  *
  */
 
-#include <unistd.h>
-#include <CoreServices/CoreServices.h>
-#include <CoreAudio/CoreAudio.h>
-#include <CoreAudio/AudioHardware.h>
-#include <CoreAudio/AudioHardwareBase.h>
+#ifndef AUDIO_SWITCH_H
+#define AUDIO_SWITCH_H
 
+#include <unistd.h>
+#include <getopt.h>
+#include "switchaudio.h"
 
-typedef enum {
-	kAudioTypeUnknown = 0,
-	kAudioTypeInput   = 1,
-	kAudioTypeOutput  = 2,
-	kAudioTypeSystemOutput = 3,
-	kAudioTypeAll = 4
-} ASDeviceType;
 
 typedef enum {
 	kFormatHuman = 0,
 	kFormatCLI = 1,
 	kFormatJSON = 2,
+	kFormatBinary = 3,    // see binary.h; -a and -c only
 } ASOutputType;
 
-typedef enum {
-	kUnmute = 0,
-	kMute = 1,
-	kToggleMute = 2,
-} ASMuteType;
-
 enum {
 	kFunctionSetDeviceByName = 1,
 	kFunctionShowHelp        = 2,
@@ -65,27 +53,88 @@ enum {
     kFunctionSetDeviceByID   = 6,
     kFunctionSetDeviceByUID  = 7,
 	kFunctionMute            = 8,
+	kFunctionCreateAggregate = 9,
+	kFunctionDestroyAggregate = 10,
+	kFunctionListAggregates  = 11,
+	kFunctionShowHistory     = 12,
+	kFunctionEnableHistory   = 13,
+	kFunctionDisableHistory  = 14,
+	kFunctionShowMetrics     = 15,
+	kFunctionMeter           = 16,
+	kFunctionMeasureLatency  = 17,
+	kFunctionComplete        = 18,
+	kFunctionCompleteUID     = 19,
+	kFunctionCompletionScript = 20,
+};
+
+// long-only options; values start above the range of the short option characters
+enum {
+	kOptionAggregate      = 256,
+	kOptionMultiOutput    = 257,
+	kOptionMembers        = 258,
+	kOptionClock          = 259,
+	kOptionDrift          = 260,
+	kOptionMakeDefault    = 261,
+	kOptionDestroy        = 262,
+	kOptionListAggregates = 263,
+	kOptionHistory        = 264,
+	kOptionHistoryEnable  = 265,
+	kOptionHistoryDisable = 266,
+	kOptionMetrics        = 267,
+	kOptionMeter          = 268,
+	kOptionInterval       = 269,
+	kOptionMeasureLatency = 270,
+	kOptionOutput         = 271,
+	kOptionInput          = 272,
+	kOptionComplete       = 273,
+	kOptionCompleteUID    = 274,
+	kOptionCompletionScript = 275,
 };
 
 
 
+// options of one invocation; strings point into argv
+typedef struct {
+	int function;
+	ASDeviceType typeRequested;
+	ASOutputType outputRequested;
+	ASMuteType muteRequested;
+	AudioDeviceID requestedDeviceID;
+	const char * requestedDeviceName;
+	const char * requestedDeviceUID;
+	const char * aggregateName;
+	const char * aggregateMembers;
+	const char * aggregateClock;
+	const char * aggregateDrift;
+	ASAggregateType aggregateType;
+	bool makeDefault;
+	bool meter;                   // -s, -u and -i choose the metered device instead of switching
+	UInt32 meterInterval;
+	const char * latencyOutput;   // defaults to the current output and input devices
+	const char * latencyInput;
+	const char * completionPrefix;
+	const char * completionShell;
+} ASRequest;
+
+
+
 void showUsage(const char * appName);
 int runAudioSwitch(int argc, const char * argv[]);
-const char * getDeviceUID(AudioDeviceID deviceID);
-AudioDeviceID getRequestedDeviceIDFromUIDSubstring(char * requestedDeviceUID, ASDeviceType typeRequested);
-AudioDeviceID getCurrentlySelectedDeviceID(ASDeviceType typeRequested);
-void getDeviceName(AudioDeviceID deviceID, char * deviceName);
-ASDeviceType getDeviceType(AudioDeviceID deviceID);
-bool isAnInputDevice(AudioDeviceID deviceID);
-bool isAnOutputDevice(AudioDeviceID deviceID);
-char *deviceTypeName(ASDeviceType device_type);
-void showCurrentlySelectedDeviceID(ASDeviceType typeRequested, ASOutputType outputRequested);
-AudioDeviceID getRequestedDeviceID(char * requestedDeviceName, ASDeviceType typeRequested);
-AudioDeviceID getNextDeviceID(AudioDeviceID currentDeviceID, ASDeviceType typeRequested);
-int setDevice(AudioDeviceID newDeviceID, ASDeviceType typeRequested);
-int setOneDevice(AudioDeviceID newDeviceID, ASDeviceType typeRequested);
-int setAllDevicesByName(char * requestedDeviceName);
-int cycleNext(ASDeviceType typeRequested);
-int cycleNextForOneDevice(ASDeviceType typeRequested);
-OSStatus setMute(ASDeviceType typeRequested, ASMuteType mute);
-void showAllDevices(ASDeviceType typeRequested, ASOutputType outputRequested);
+int runRequest(ASContext * context, const ASRequest * request, const char * appName);
+const char * statusErrorString(OSStatus status);
+OSStatus findDevice(ASContext * context, const char * name, const char * uid, ASDeviceType typeRequested, AudioDeviceID * deviceID);
+int showCurrentlySelectedDeviceID(ASContext * context, ASDeviceType typeRequested, ASOutputType outputRequested);
+int setDevice(ASContext * context, AudioDeviceID newDeviceID, ASDeviceType typeRequested);
+int setAllDevicesByName(ASContext * context, const char * requestedDeviceName);
+int cycleNext(ASContext * context, ASDeviceType typeRequested);
+int cycleNextForOneDevice(ASContext * context, ASDeviceType typeRequested, UInt32 steps);
+int muteDevice(ASContext * context, ASDeviceType typeRequested, ASMuteType muteRequested);
+int meterDevice(ASContext * context, const ASRequest * request);
+int measureLatency(ASContext * context, const ASRequest * request);
+int showAllDevices(ASContext * context, ASDeviceType typeRequested, ASOutputType outputRequested);
+int createAggregateDevice(ASContext * context, const char * aggregateName, const char * memberList, const char * clockMember,
+                          const char * driftList, ASAggregateType aggregateType, AudioDeviceID * newDeviceID);
+int destroyAggregateDevice(ASContext * context, const char * requested);
+void showAggregateDevices(ASContext * context, ASOutputType outputRequested);
+
+#endif
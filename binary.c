@@ -0,0 +1,200 @@
+/*
+ *  binary.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "binary.h"
+
+
+static void reserve(ASBinaryWriter * writer, size_t extra) {
+    if (writer->failed || writer->length + extra <= writer->capacity) {
+        return;
+    }
+    size_t capacity = writer->capacity ? writer->capacity : 1024;
+    while (capacity < writer->length + extra) {
+        capacity *= 2;
+    }
+    uint8_t * data = (uint8_t *)realloc(writer->data, capacity);
+    if (data == NULL) {
+        writer->failed = true;
+        return;
+    }
+    writer->data = data;
+    writer->capacity = capacity;
+}
+
+static void putBytes(ASBinaryWriter * writer, const void * bytes, size_t count) {
+    reserve(writer, count);
+    if (!writer->failed) {
+        memcpy(writer->data + writer->length, bytes, count);
+        writer->length += count;
+    }
+}
+
+static void putU8(ASBinaryWriter * writer, uint8_t value) {
+    putBytes(writer, &value, 1);
+}
+
+static void putU16(ASBinaryWriter * writer, uint16_t value) {
+    uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    putBytes(writer, bytes, sizeof(bytes));
+}
+
+static void putU32(ASBinaryWriter * writer, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    putBytes(writer, bytes, sizeof(bytes));
+}
+
+static void putString(ASBinaryWriter * writer, const char * string) {
+    size_t length = string ? strlen(string) : 0;
+    if (length > UINT16_MAX) length = UINT16_MAX;
+    putU16(writer, (uint16_t)length);
+    putBytes(writer, string, length);
+}
+
+static uint16_t getU16(const uint8_t * bytes) {
+    return (uint16_t)(bytes[0] | bytes[1] << 8);
+}
+
+static uint32_t getU32(const uint8_t * bytes) {
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+void binaryWriterInit(ASBinaryWriter * writer) {
+    memset(writer, 0, sizeof(*writer));
+    putBytes(writer, kBinaryMagic, 4);
+    putU8(writer, kBinaryVersion);
+    putU8(writer, 0);
+    putU16(writer, kBinaryHeaderLength);
+}
+
+void binaryBeginDevice(ASBinaryWriter * writer, uint32_t deviceID, uint8_t typeBits, const char * name, const char * uid) {
+    writer->recordStart = writer->length;
+    putU32(writer, 0);    // patched by binaryEndDevice
+    putU32(writer, deviceID);
+    putU8(writer, typeBits);
+    putString(writer, name);
+    putString(writer, uid);
+}
+
+void binaryAppendField(ASBinaryWriter * writer, uint8_t tag, const void * value, uint16_t length) {
+    putU8(writer, tag);
+    putU16(writer, length);
+    putBytes(writer, value, length);
+}
+
+void binaryEndDevice(ASBinaryWriter * writer) {
+    if (writer->failed) {
+        return;
+    }
+    uint32_t length = (uint32_t)(writer->length - writer->recordStart - 4);
+    uint8_t * bytes = writer->data + writer->recordStart;
+    bytes[0] = (uint8_t)length;
+    bytes[1] = (uint8_t)(length >> 8);
+    bytes[2] = (uint8_t)(length >> 16);
+    bytes[3] = (uint8_t)(length >> 24);
+}
+
+int binaryWriterFlush(ASBinaryWriter * writer, FILE * file) {
+    int result = -1;
+    if (!writer->failed && fwrite(writer->data, 1, writer->length, file) == writer->length) {
+        result = fflush(file) == 0 ? 0 : -1;
+    }
+    free(writer->data);
+    memset(writer, 0, sizeof(*writer));
+    return result;
+}
+
+int binaryDecodeHeader(const uint8_t * data, size_t length, size_t * outOffset) {
+    if (length < kBinaryHeaderLength || memcmp(data, kBinaryMagic, 4) != 0 || data[4] != kBinaryVersion) {
+        return -1;
+    }
+    size_t headerLength = getU16(data + 6);
+    if (headerLength < kBinaryHeaderLength || headerLength > length) {
+        return -1;
+    }
+    *outOffset = headerLength;
+    return 0;
+}
+
+int binaryDecodeDevice(const uint8_t * data, size_t length, size_t * offset, ASBinaryDevice * outDevice) {
+    size_t position = *offset;
+    if (position == length) {
+        return 0;
+    }
+    if (length - position < 4) {
+        return -1;
+    }
+    size_t recordLength = getU32(data + position);
+    position += 4;
+    if (recordLength > length - position || recordLength < 4 + 1 + 2 + 2) {
+        return -1;
+    }
+    const uint8_t * record = data + position;
+    const uint8_t * end = record + recordLength;
+
+    outDevice->deviceID = getU32(record);
+    outDevice->typeBits = record[4];
+    record += 5;
+    outDevice->nameLength = getU16(record);
+    if ((size_t)(end - record) < 2u + outDevice->nameLength + 2u) {
+        return -1;
+    }
+    outDevice->name = (const char *)record + 2;
+    record += 2 + outDevice->nameLength;
+    outDevice->uidLength = getU16(record);
+    if ((size_t)(end - record) < 2u + outDevice->uidLength) {
+        return -1;
+    }
+    outDevice->uid = (const char *)record + 2;
+    record += 2 + outDevice->uidLength;
+    outDevice->fields = record;
+    outDevice->fieldsLength = (size_t)(end - record);
+
+    *offset = position + recordLength;
+    return 1;
+}
+
+int binaryDecodeField(ASBinaryDevice * device, uint8_t * outTag, const uint8_t ** outValue, uint16_t * outLength) {
+    if (device->fieldsLength == 0) {
+        return 0;
+    }
+    if (device->fieldsLength < 3) {
+        return -1;
+    }
+    uint16_t valueLength = getU16(device->fields + 1);
+    if (valueLength > device->fieldsLength - 3) {
+        return -1;
+    }
+    *outTag = device->fields[0];
+    *outValue = device->fields + 3;
+    *outLength = valueLength;
+    device->fields += 3 + valueLength;
+    device->fieldsLength -= 3 + valueLength;
+    return 1;
+}
@@ -0,0 +1,103 @@
+/*
+ *  binary.h
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef BINARY_H
+#define BINARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// The binary output format of -a and -c.  All integers are little-endian and
+// strings are UTF-8 without a terminating zero.
+//
+//   stream  := header record*
+//   header  := magic "SAbn" | u8 version | u8 reserved | u16 header length
+//   record  := u32 length of the rest of the record | u32 device id
+//              | u8 type bits | u16 name length | name | u16 uid length | uid
+//              | field*
+//   field   := u8 tag | u16 value length | value
+//
+// Readers skip header bytes beyond the ones they know and fields with unknown
+// tags, so both can be extended without changing the version.  The version
+// only changes when existing bytes change their meaning.
+
+#define kBinaryMagic         "SAbn"
+#define kBinaryVersion       1
+#define kBinaryHeaderLength  8
+
+// type bits
+#define kBinaryTypeInput     0x01
+#define kBinaryTypeOutput    0x02
+#define kBinaryTypeAggregate 0x04
+
+// field tags
+#define kBinaryFieldMember   1    // aggregate member name, or its uid while unavailable; repeated in member order
+#define kBinaryFieldDefault  2    // u8 role this device is the current device of, see below
+
+// roles of kBinaryFieldDefault; they match ASDeviceType but are fixed by the format
+#define kBinaryRoleInput     1
+#define kBinaryRoleOutput    2
+#define kBinaryRoleSystem    3
+
+// encoder; records are collected in one buffer and written with a single call
+typedef struct {
+	uint8_t * data;
+	size_t length;
+	size_t capacity;
+	size_t recordStart;
+	bool failed;             // set when memory ran out, nothing is written then
+} ASBinaryWriter;
+
+void binaryWriterInit(ASBinaryWriter * writer);
+void binaryBeginDevice(ASBinaryWriter * writer, uint32_t deviceID, uint8_t typeBits, const char * name, const char * uid);
+void binaryAppendField(ASBinaryWriter * writer, uint8_t tag, const void * value, uint16_t length);
+void binaryEndDevice(ASBinaryWriter * writer);
+int binaryWriterFlush(ASBinaryWriter * writer, FILE * file);
+
+// decoder; decoded strings and fields point into the input
+typedef struct {
+	uint32_t deviceID;
+	uint8_t typeBits;
+	const char * name;
+	uint16_t nameLength;
+	const char * uid;
+	uint16_t uidLength;
+	const uint8_t * fields;
+	size_t fieldsLength;
+} ASBinaryDevice;
+
+// returns -1 unless data starts with a header of a version this decoder reads
+int binaryDecodeHeader(const uint8_t * data, size_t length, size_t * outOffset);
+// returns 1 and advances offset past a record, 0 at the end and -1 if the record is malformed
+int binaryDecodeDevice(const uint8_t * data, size_t length, size_t * offset, ASBinaryDevice * outDevice);
+// returns 1 and advances past a field of the device, 0 after the last one and -1 if it is malformed
+int binaryDecodeField(ASBinaryDevice * device, uint8_t * outTag, const uint8_t ** outValue, uint16_t * outLength);
+
+#endif
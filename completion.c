@@ -0,0 +1,428 @@
+/*
+ *  completion.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "completion.h"
+
+
+// a loaded or freshly built index; header points to one allocation holding it all
+typedef struct {
+    ASCompletionHeader * header;
+    const ASCompletionEntry * entries;
+    const char * strings;
+    size_t size;
+} ASCompletionIndex;
+
+typedef struct {
+    const char * string;
+    UInt8 kind;
+    UInt8 typeBits;
+} ASCompletionItem;
+
+static void getIndexPath(char * path, size_t size) {
+    const char * tmpdir = getenv("TMPDIR");
+    snprintf(path, size, "%s/SwitchAudioSource.completion", (tmpdir && tmpdir[0]) ? tmpdir : "/tmp");
+}
+
+// checks that every entry points into the strings before anything is read through it
+static bool attachIndex(ASCompletionIndex * index, void * data, size_t size) {
+    ASCompletionHeader * header = (ASCompletionHeader *)data;
+
+    if (size < sizeof(ASCompletionHeader) || header->magic != kCompletionMagic || header->version != kCompletionVersion) {
+        return false;
+    }
+    size_t entriesSize = (size_t)header->entryCount * sizeof(ASCompletionEntry);
+    if (size != sizeof(ASCompletionHeader) + entriesSize + header->stringsLength) {
+        return false;
+    }
+    const ASCompletionEntry * entries = (const ASCompletionEntry *)(header + 1);
+    const char * strings = (const char *)(entries + header->entryCount);
+    if (header->stringsLength > 0 && strings[header->stringsLength - 1] != '\0') {
+        return false;
+    }
+    for (UInt32 i = 0; i < header->entryCount; ++i) {
+        if (entries[i].offset >= header->stringsLength) {
+            return false;
+        }
+    }
+
+    index->header = header;
+    index->entries = entries;
+    index->strings = strings;
+    index->size = size;
+    return true;
+}
+
+static bool loadIndex(ASCompletionIndex * index) {
+    char path[1024];
+    struct stat info;
+
+    getIndexPath(path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    void * data = NULL;
+    size_t size = 0;
+    if (fstat(fd, &info) == 0 && info.st_size > 0 && info.st_size < 16 * 1024 * 1024) {
+        size = (size_t)info.st_size;
+        data = malloc(size);
+        if (data != NULL && read(fd, data, size) != (ssize_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    close(fd);
+
+    if (data == NULL || !attachIndex(index, data, size)) {
+        free(data);
+        return false;
+    }
+    return true;
+}
+
+// replaces the index file at once, so readers see either the old or the new one
+static void saveIndex(const ASCompletionIndex * index) {
+    char path[1024];
+    char temporaryPath[1040];
+
+    getIndexPath(path, sizeof(path));
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.XXXXXX", path);
+    int fd = mkstemp(temporaryPath);
+    if (fd < 0) {
+        return;
+    }
+    bool written = write(fd, index->header, index->size) == (ssize_t)index->size;
+    close(fd);
+    if (!written || rename(temporaryPath, path) != 0) {
+        unlink(temporaryPath);
+    }
+}
+
+// extends the trust in the index without rewriting it
+static void touchIndex(ASCompletionIndex * index, UInt64 now) {
+    char path[1024];
+
+    index->header->checkedAt = now;
+    getIndexPath(path, sizeof(path));
+    int fd = open(path, O_WRONLY);
+    if (fd >= 0) {
+        pwrite(fd, &now, sizeof(now), offsetof(ASCompletionHeader, checkedAt));
+        close(fd);
+    }
+}
+
+static int compareItems(const void * a, const void * b) {
+    const ASCompletionItem * itemA = (const ASCompletionItem *)a;
+    const ASCompletionItem * itemB = (const ASCompletionItem *)b;
+    if (itemA->kind != itemB->kind) {
+        return itemA->kind < itemB->kind ? -1 : 1;
+    }
+    return strcmp(itemA->string, itemB->string);
+}
+
+static bool buildIndex(ASContext * context, ASCompletionIndex * index, UInt64 now) {
+    const ASDeviceInfo * devices = NULL;
+    UInt32 deviceCount = 0;
+    UInt64 fingerprint = 0;
+
+    // the fingerprint is taken first, so a device added meanwhile only causes another rebuild
+    if (ASGetDeviceListFingerprint(context, &fingerprint) != noErr || ASContextRefresh(context) != noErr
+        || ASContextGetDevices(context, &devices, &deviceCount) != noErr) {
+        return false;
+    }
+
+    ASCompletionItem * items = (ASCompletionItem *)malloc((deviceCount * 2 + 1) * sizeof(ASCompletionItem));
+    if (items == NULL) {
+        return false;
+    }
+    UInt32 itemCount = 0;
+    for (UInt32 i = 0; i < deviceCount; ++i) {
+        UInt8 typeBits = (devices[i].hasInput ? kCompletionInput : 0) | (devices[i].hasOutput ? kCompletionOutput : 0);
+        if (devices[i].name[0] != '\0') {
+            items[itemCount++] = (ASCompletionItem){devices[i].name, kCompletionName, typeBits};
+        }
+        if (devices[i].uid[0] != '\0') {
+            items[itemCount++] = (ASCompletionItem){devices[i].uid, kCompletionUID, typeBits};
+        }
+    }
+    qsort(items, itemCount, sizeof(ASCompletionItem), compareItems);
+
+    // devices sharing a name get one entry with the type bits of all of them
+    UInt32 uniqueCount = 0;
+    size_t stringsLength = 0;
+    for (UInt32 i = 0; i < itemCount; ++i) {
+        if (uniqueCount > 0 && compareItems(&items[uniqueCount - 1], &items[i]) == 0) {
+            items[uniqueCount - 1].typeBits |= items[i].typeBits;
+            continue;
+        }
+        items[uniqueCount++] = items[i];
+        stringsLength += strlen(items[i].string) + 1;
+    }
+
+    size_t size = sizeof(ASCompletionHeader) + uniqueCount * sizeof(ASCompletionEntry) + stringsLength;
+    ASCompletionHeader * header = (ASCompletionHeader *)calloc(1, size);
+    if (header == NULL) {
+        free(items);
+        return false;
+    }
+    header->magic = kCompletionMagic;
+    header->version = kCompletionVersion;
+    header->createdAt = now;
+    header->checkedAt = now;
+    header->fingerprint = fingerprint;
+    header->entryCount = uniqueCount;
+    header->stringsLength = (UInt32)stringsLength;
+
+    ASCompletionEntry * entries = (ASCompletionEntry *)(header + 1);
+    char * strings = (char *)(entries + uniqueCount);
+    UInt32 offset = 0;
+    for (UInt32 i = 0; i < uniqueCount; ++i) {
+        size_t length = strlen(items[i].string) + 1;
+        memcpy(strings + offset, items[i].string, length);
+        entries[i] = (ASCompletionEntry){offset, items[i].kind, items[i].typeBits, 0};
+        offset += (UInt32)length;
+    }
+    free(items);
+
+    index->header = header;
+    index->entries = entries;
+    index->strings = strings;
+    index->size = size;
+    return true;
+}
+
+// the first entry of the kind not sorting before the prefix; all matches follow it
+static UInt32 findFirstEntry(const ASCompletionIndex * index, UInt8 kind, const char * prefix) {
+    UInt32 low = 0;
+    UInt32 high = index->header->entryCount;
+    while (low < high) {
+        UInt32 middle = low + (high - low) / 2;
+        const ASCompletionEntry * entry = &index->entries[middle];
+        int order = entry->kind != kind ? (entry->kind < kind ? -1 : 1) : strcmp(index->strings + entry->offset, prefix);
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// single quotes anything a shell would split or expand
+static void printQuoted(const char * string) {
+    bool plain = true;
+    for (const char * c = string; *c != '\0' && plain; ++c) {
+        plain = isalnum((unsigned char)*c) || strchr("%+,-./:=@_", *c) != NULL;
+    }
+    if (plain) {
+        printf("%s\n", string);
+        return;
+    }
+    putchar('\'');
+    for (const char * c = string; *c != '\0'; ++c) {
+        if (*c == '\'') {
+            fputs("'\\''", stdout);
+        } else {
+            putchar(*c);
+        }
+    }
+    fputs("'\n", stdout);
+}
+
+int completeDevices(ASContext * context, const char * prefix, UInt8 kind, ASDeviceType typeRequested, ASOutputType outputRequested) {
+    ASCompletionIndex index;
+    UInt64 now = (UInt64)time(NULL);
+    bool current = false;
+
+    if (loadIndex(&index)) {
+        ASCompletionHeader * header = index.header;
+        if (now >= header->createdAt && now - header->createdAt < kCompletionMaxAgeSeconds) {
+            UInt64 fingerprint = 0;
+            if (now >= header->checkedAt && now - header->checkedAt < kCompletionRecheckSeconds) {
+                current = true;
+            } else if (ASGetDeviceListFingerprint(context, &fingerprint) == noErr && fingerprint == header->fingerprint) {
+                touchIndex(&index, now);
+                current = true;
+            }
+        }
+        if (!current) {
+            free(index.header);
+        }
+    }
+    if (!current) {
+        // stale or missing, enumerate the devices once and keep the result for the next keypress
+        if (!buildIndex(context, &index, now)) {
+            fprintf(stderr, "Could not read the audio devices.\n");
+            return 1;
+        }
+        saveIndex(&index);
+    }
+
+    UInt8 typeBits = 0;
+    if (typeRequested == kAudioTypeInput) {
+        typeBits = kCompletionInput;
+    } else if (typeRequested == kAudioTypeOutput || typeRequested == kAudioTypeSystemOutput) {
+        typeBits = kCompletionOutput;
+    }
+
+    size_t prefixLength = strlen(prefix);
+    for (UInt32 i = findFirstEntry(&index, kind, prefix); i < index.header->entryCount; ++i) {
+        const ASCompletionEntry * entry = &index.entries[i];
+        const char * string = index.strings + entry->offset;
+        if (entry->kind != kind || strncmp(string, prefix, prefixLength) != 0) {
+            break;
+        }
+        if (typeBits != 0 && (entry->typeBits & typeBits) == 0) {
+            continue;
+        }
+        if (outputRequested == kFormatHuman) {
+            printQuoted(string);
+        } else {
+            printf("%s\n", string);
+        }
+    }
+    free(index.header);
+    return 0;
+}
+
+static const char * bashScript =
+    "# bash completion for %1$s\n"
+    "_%2$s() {\n"
+    "    local cur prev words cword i\n"
+    "    local -a type\n"
+    "    if declare -F _get_comp_words_by_ref >/dev/null; then\n"
+    "        _get_comp_words_by_ref -n : cur prev words cword\n"
+    "    else\n"
+    "        # without bash-completion, put back together what COMP_WORDBREAKS split at colons\n"
+    "        local j=-1 joined=0\n"
+    "        words=()\n"
+    "        for ((i = 0; i < ${#COMP_WORDS[@]}; i++)); do\n"
+    "            if ((j >= 0)) && [[ ${COMP_WORDS[i]} == : || $joined == 1 ]]; then\n"
+    "                words[j]+=${COMP_WORDS[i]}\n"
+    "            else\n"
+    "                words[++j]=${COMP_WORDS[i]}\n"
+    "            fi\n"
+    "            [[ ${COMP_WORDS[i]} == : ]] && joined=1 || joined=0\n"
+    "            ((i == COMP_CWORD)) && cword=$j\n"
+    "        done\n"
+    "        cur=${words[cword]} prev=${words[cword-1]}\n"
+    "    fi\n"
+    "    for ((i = 1; i < cword - 1; i++)); do\n"
+    "        [[ ${words[i]} == -t ]] && type=(-t \"${words[i+1]}\")\n"
+    "    done\n"
+    "    cur=${cur#[\\\"\\']}\n"
+    "    local IFS=$'\\n'\n"
+    "    case $prev in\n"
+    "        -s) COMPREPLY=($(%1$s --complete \"$cur\" \"${type[@]}\" 2>/dev/null)) ;;\n"
+    "        -u) COMPREPLY=($(%1$s --complete-uid \"$cur\" \"${type[@]}\" 2>/dev/null)) ;;\n"
+    "        -t) COMPREPLY=($(compgen -W $'input\\noutput\\nsystem\\nall' -- \"$cur\")) ;;\n"
+    "        -f) COMPREPLY=($(compgen -W $'cli\\nhuman\\njson\\nbinary' -- \"$cur\")) ;;\n"
+    "        -m) COMPREPLY=($(compgen -W $'mute\\nunmute\\ntoggle' -- \"$cur\")) ;;\n"
+    "        *) COMPREPLY=($(compgen -W $'-a\\n-c\\n-f\\n-t\\n-m\\n-n\\n-i\\n-u\\n-s\\n-h' -- \"$cur\")) ;;\n"
+    "    esac\n"
+    "    # bash replaces only the part of the word after the last colon\n"
+    "    if [[ $cur == *:* && $COMP_WORDBREAKS == *:* ]]; then\n"
+    "        local colon=${cur%%\"${cur##*:}\"}\n"
+    "        COMPREPLY=(\"${COMPREPLY[@]#\"$colon\"}\")\n"
+    "    fi\n"
+    "}\n"
+    "complete -F _%2$s %1$s\n";
+
+static const char * zshScript =
+    "#compdef %1$s\n"
+    "_%2$s() {\n"
+    "    local state i=${words[(i)-t]}\n"
+    "    local -a type devices\n"
+    "    (( i < CURRENT - 1 )) && type=(-t ${words[i+1]})\n"
+    "    _arguments \\\n"
+    "        '-a[show all devices]' \\\n"
+    "        '-c[show current device]' \\\n"
+    "        '-f[output format]:format:(cli human json binary)' \\\n"
+    "        '-t[device type]:type:(input output system all)' \\\n"
+    "        '-m[mute status]:mute:(mute unmute toggle)' \\\n"
+    "        '-n[cycle to the next device]' \\\n"
+    "        '-i[device id]:id:' \\\n"
+    "        '-s[device name]:device name:->name' \\\n"
+    "        '-u[device uid]:device uid:->uid'\n"
+    "    case $state in\n"
+    "        name) devices=(${(f)\"$(%1$s --complete \"$PREFIX\" $type -f cli 2>/dev/null)\"}) ;;\n"
+    "        uid) devices=(${(f)\"$(%1$s --complete-uid \"$PREFIX\" $type -f cli 2>/dev/null)\"}) ;;\n"
+    "    esac\n"
+    "    (( ${#devices} )) && compadd -a devices\n"
+    "}\n"
+    "if [[ $zsh_eval_context[-1] == loadautofunc ]]; then\n"
+    "    _%2$s \"$@\"\n"
+    "else\n"
+    "    compdef _%2$s %1$s\n"
+    "fi\n";
+
+static const char * fishScript =
+    "# fish completion for %1$s\n"
+    "complete -c %1$s -s s -x -d 'device name' -a '(%1$s --complete (commandline -ct) -f cli 2>/dev/null)'\n"
+    "complete -c %1$s -s u -x -d 'device uid' -a '(%1$s --complete-uid (commandline -ct) -f cli 2>/dev/null)'\n"
+    "complete -c %1$s -s t -x -d 'device type' -a 'input output system all'\n"
+    "complete -c %1$s -s f -x -d 'output format' -a 'cli human json binary'\n"
+    "complete -c %1$s -s m -x -d 'mute status' -a 'mute unmute toggle'\n"
+    "complete -c %1$s -s i -x -d 'device id'\n"
+    "complete -c %1$s -s a -d 'show all devices'\n"
+    "complete -c %1$s -s c -d 'show current device'\n"
+    "complete -c %1$s -s n -d 'cycle to the next device'\n";
+
+int showCompletionScript(const char * shell, const char * appName) {
+    char functionName[256];
+    const char * name = strrchr(appName, '/') ? strrchr(appName, '/') + 1 : appName;
+    const char * script = NULL;
+
+    if (strcmp(shell, "bash") == 0) {
+        script = bashScript;
+    } else if (strcmp(shell, "zsh") == 0) {
+        script = zshScript;
+    } else if (strcmp(shell, "fish") == 0) {
+        script = fishScript;
+    } else {
+        printf("Unknown shell %s.  Completion scripts are available for bash, zsh and fish.\n", shell);
+        return 1;
+    }
+
+    // shell function names are kept to characters every shell accepts
+    size_t length = 0;
+    for (const char * c = name; *c != '\0' && length < sizeof(functionName) - 1; ++c) {
+        functionName[length++] = isalnum((unsigned char)*c) ? (char)tolower((unsigned char)*c) : '_';
+    }
+    functionName[length] = '\0';
+
+    printf(script, name, functionName);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ *  completion.h
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include "audio_switch.h"
+
+// Shell completion of device names and uids.  Completions are answered from
+// an index file under $TMPDIR holding every name and uid sorted by kind and
+// bytes, so a prefix is found by binary search without asking the HAL.  The
+// index is trusted for kCompletionRecheckSeconds; after that the device ids,
+// names and stream directions are compared with the ones it was built from,
+// and it is rebuilt from a live enumeration when they differ or it is older
+// than kCompletionMaxAgeSeconds.
+
+#define kCompletionMagic          'SAcx'
+#define kCompletionVersion        1
+#define kCompletionRecheckSeconds 10
+#define kCompletionMaxAgeSeconds  3600
+
+enum {
+	kCompletionName = 0,
+	kCompletionUID  = 1,
+};
+
+// type bits
+#define kCompletionInput  0x01
+#define kCompletionOutput 0x02
+
+typedef struct {
+	UInt32 magic;
+	UInt32 version;
+	UInt64 createdAt;         // seconds since 1970
+	UInt64 checkedAt;         // last time the device ids were found unchanged
+	UInt64 fingerprint;       // ASGetDeviceListFingerprint when built
+	UInt32 entryCount;
+	UInt32 stringsLength;
+} ASCompletionHeader;
+
+// followed by entryCount entries and the zero terminated strings
+typedef struct {
+	UInt32 offset;            // into the strings
+	UInt8 kind;               // kCompletionName or kCompletionUID
+	UInt8 typeBits;           // of all devices with this name or uid
+	UInt16 reserved;
+} ASCompletionEntry;
+
+int completeDevices(ASContext * context, const char * prefix, UInt8 kind, ASDeviceType typeRequested, ASOutputType outputRequested);
+int showCompletionScript(const char * shell, const char * appName);
+
+#endif
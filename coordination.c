@@ -0,0 +1,148 @@
+/*
+ *  coordination.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "coordination.h"
+
+
+static int stateFD = -1;
+static ASCoordinationState * state = NULL;
+
+// maps the shared state, creating it on first use.  Returns NULL when it is
+// unavailable, in which case every request is handled on its own.
+static ASCoordinationState * getCoordinationState(void) {
+    char path[1024];
+    const char * tmpdir = getenv("TMPDIR");
+
+    if (state != NULL) {
+        return state;
+    }
+
+    snprintf(path, sizeof(path), "%s/SwitchAudioSource.state", (tmpdir && tmpdir[0]) ? tmpdir : "/tmp");
+    stateFD = open(path, O_RDWR | O_CREAT, 0600);
+    if (stateFD < 0) {
+        return NULL;
+    }
+    if (ftruncate(stateFD, sizeof(ASCoordinationState)) != 0) {
+        close(stateFD);
+        stateFD = -1;
+        return NULL;
+    }
+
+    void * mapped = mmap(NULL, sizeof(ASCoordinationState), PROT_READ | PROT_WRITE, MAP_SHARED, stateFD, 0);
+    if (mapped == MAP_FAILED) {
+        close(stateFD);
+        stateFD = -1;
+        return NULL;
+    }
+    state = (ASCoordinationState *)mapped;
+
+    // a file from an older layout is reset; new files are already zero filled
+    if (__atomic_load_n(&state->version, __ATOMIC_ACQUIRE) != kCoordinationStateVersion) {
+        flock(stateFD, LOCK_EX);
+        if (state->version != kCoordinationStateVersion) {
+            memset(state, 0, sizeof(ASCoordinationState));
+            __atomic_store_n(&state->version, kCoordinationStateVersion, __ATOMIC_RELEASE);
+        }
+        flock(stateFD, LOCK_UN);
+    }
+    return state;
+}
+
+static void acquireSwitchLock(void) {
+    if (stateFD >= 0) {
+        while (flock(stateFD, LOCK_EX) != 0 && errno == EINTR) {}
+    }
+}
+
+// Records one press of "cycle to next" and waits for exclusive access to the
+// HAL.  Returns the number of presses to apply, which includes those queued by
+// other invocations while this one was waiting, or 0 when another invocation
+// already applied this press.
+UInt32 queueCycleRequest(ASDeviceType typeRequested) {
+    if (getCoordinationState() == NULL) {
+        return 1;
+    }
+
+    // the press is recorded before waiting so whoever holds the lock next folds it in
+    __atomic_fetch_add(&state->pendingCycles[typeRequested], 1, __ATOMIC_ACQ_REL);
+    acquireSwitchLock();
+    return __atomic_exchange_n(&state->pendingCycles[typeRequested], 0, __ATOMIC_ACQ_REL);
+}
+
+// Queues a request to set the device and waits for exclusive access to the
+// HAL.  Returns the sequence number to pass to isLatestSetRequest.
+UInt32 queueSetRequest(ASDeviceType typeRequested) {
+    if (getCoordinationState() == NULL) {
+        return 0;
+    }
+
+    UInt32 sequence = __atomic_add_fetch(&state->setSequence[typeRequested], 1, __ATOMIC_ACQ_REL);
+    acquireSwitchLock();
+    return sequence;
+}
+
+// false when a newer set request is queued; that one will do the switch instead
+bool isLatestSetRequest(ASDeviceType typeRequested, UInt32 sequence) {
+    if (state == NULL) {
+        return true;
+    }
+    return __atomic_load_n(&state->setSequence[typeRequested], __ATOMIC_ACQUIRE) == sequence;
+}
+
+void finishRequest(void) {
+    if (stateFD >= 0) {
+        flock(stateFD, LOCK_UN);
+    }
+}
+
+int coordinateCycle(ASDeviceType typeRequested, ASCycleFunction cycle, void * userData) {
+    int result = 0;
+    UInt32 steps = queueCycleRequest(typeRequested);
+    if (steps > 0) {
+        result = cycle(typeRequested, steps, userData);
+    }
+    finishRequest();
+    return result;
+}
+
+int coordinateSet(ASDeviceType typeRequested, ASSetFunction set, void * userData, bool * superseded) {
+    int result = 0;
+    UInt32 sequence = queueSetRequest(typeRequested);
+    *superseded = !isLatestSetRequest(typeRequested, sequence);
+    if (!*superseded) {
+        result = set(typeRequested, userData);
+    }
+    finishRequest();
+    return result;
+}
@@ -0,0 +1,64 @@
+/*
+ *  coordination.h
+ *  AudioSwitcher
+ *
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ *
+ */
+
+#ifndef COORDINATION_H
+#define COORDINATION_H
+
+#include "switchaudio.h"
+
+// State shared by all concurrently running invocations.  It lives in a small
+// file under $TMPDIR that is mapped into every process; the same file is
+// flock()ed to serialize the HAL writes.
+typedef struct {
+	UInt32 version;
+	UInt32 pendingCycles[kAudioTypeAll + 1];  // presses not yet applied, by ASDeviceType
+	UInt32 setSequence[kAudioTypeAll + 1];    // last queued set request, by ASDeviceType
+} ASCoordinationState;
+
+#define kCoordinationStateVersion 1
+
+// The HAL writes are passed in, so the coordination can be exercised without
+// audio hardware.  Both are called with the switch lock held.
+typedef int (*ASCycleFunction)(ASDeviceType typeRequested, UInt32 steps, void * userData);
+typedef int (*ASSetFunction)(ASDeviceType typeRequested, void * userData);
+
+UInt32 queueCycleRequest(ASDeviceType typeRequested);
+UInt32 queueSetRequest(ASDeviceType typeRequested);
+bool isLatestSetRequest(ASDeviceType typeRequested, UInt32 sequence);
+void finishRequest(void);
+
+// Applies one press of "cycle to next" together with the presses queued
+// meanwhile, or nothing when another invocation already applied it.
+int coordinateCycle(ASDeviceType typeRequested, ASCycleFunction cycle, void * userData);
+// Sets the device unless a newer set request is queued; superseded tells which.
+int coordinateSet(ASDeviceType typeRequested, ASSetFunction set, void * userData, bool * superseded);
+
+#endif
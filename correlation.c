@@ -0,0 +1,141 @@
+/*
+ *  correlation.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#include <math.h>
+#include <stdlib.h>
+#include "correlation.h"
+
+
+typedef struct {
+    double re;
+    double im;
+} ASComplex;
+
+// in-place iterative radix-2 FFT; count must be a power of two and inverse
+// transforms are left unscaled
+static void transform(ASComplex * data, size_t count, int inverse) {
+    for (size_t i = 1, j = 0; i < count; ++i) {
+        size_t bit = count >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j |= bit;
+        if (i < j) {
+            ASComplex swap = data[i];
+            data[i] = data[j];
+            data[j] = swap;
+        }
+    }
+
+    for (size_t length = 2; length <= count; length <<= 1) {
+        double angle = (inverse ? 2.0 : -2.0) * M_PI / (double)length;
+        ASComplex step = {cos(angle), sin(angle)};
+        for (size_t start = 0; start < count; start += length) {
+            ASComplex twiddle = {1.0, 0.0};
+            for (size_t k = 0; k < length / 2; ++k) {
+                ASComplex * even = &data[start + k];
+                ASComplex * odd = &data[start + k + length / 2];
+                ASComplex product = {odd->re * twiddle.re - odd->im * twiddle.im, odd->re * twiddle.im + odd->im * twiddle.re};
+                odd->re = even->re - product.re;
+                odd->im = even->im - product.im;
+                even->re += product.re;
+                even->im += product.im;
+                double re = twiddle.re * step.re - twiddle.im * step.im;
+                twiddle.im = twiddle.re * step.im + twiddle.im * step.re;
+                twiddle.re = re;
+            }
+        }
+    }
+}
+
+int findSignalDelay(const float * signal, size_t signalCount, const float * capture, size_t captureCount,
+                    size_t * outDelay, double * outCorrelation) {
+    if (signalCount == 0 || signalCount > captureCount) {
+        return -1;
+    }
+
+    // lags up to captureCount - signalCount must not wrap onto each other
+    size_t count = 1;
+    while (count < captureCount + signalCount) {
+        count <<= 1;
+    }
+
+    // both real inputs share one complex transform: the signal in the real
+    // part and the capture in the imaginary part
+    ASComplex * data = (ASComplex *)calloc(count, sizeof(ASComplex));
+    ASComplex * spectrum = (ASComplex *)malloc(count * sizeof(ASComplex));
+    if (data == NULL || spectrum == NULL) {
+        free(data);
+        free(spectrum);
+        return -1;
+    }
+    for (size_t i = 0; i < signalCount; ++i) {
+        data[i].re = signal[i];
+    }
+    for (size_t i = 0; i < captureCount; ++i) {
+        data[i].im = capture[i];
+    }
+    transform(data, count, 0);
+
+    // separate the two spectra and multiply the capture by the conjugate of
+    // the signal: S = (Z[k] + conj(Z[-k])) / 2, C = (Z[k] - conj(Z[-k])) / 2i
+    for (size_t k = 0; k < count; ++k) {
+        ASComplex z = data[k];
+        ASComplex mirror = data[(count - k) & (count - 1)];
+        ASComplex s = {(z.re + mirror.re) / 2.0, (z.im - mirror.im) / 2.0};
+        ASComplex c = {(z.im + mirror.im) / 2.0, (mirror.re - z.re) / 2.0};
+        spectrum[k].re = c.re * s.re + c.im * s.im;
+        spectrum[k].im = c.im * s.re - c.re * s.im;
+    }
+    transform(spectrum, count, 1);
+
+    // an inverted copy, e.g. from a loopback with swapped polarity, is as
+    // good a match as a straight one
+    size_t bestLag = 0;
+    double bestValue = -1.0;
+    for (size_t lag = 0; lag + signalCount <= captureCount; ++lag) {
+        if (fabs(spectrum[lag].re) > bestValue) {
+            bestValue = fabs(spectrum[lag].re);
+            bestLag = lag;
+        }
+    }
+
+    double signalEnergy = 0.0;
+    double captureEnergy = 0.0;
+    for (size_t i = 0; i < signalCount; ++i) {
+        signalEnergy += (double)signal[i] * signal[i];
+        captureEnergy += (double)capture[bestLag + i] * capture[bestLag + i];
+    }
+    double energy = sqrt(signalEnergy * captureEnergy);
+
+    *outDelay = bestLag;
+    *outCorrelation = energy > 0.0 ? bestValue / (double)count / energy : 0.0;
+    free(data);
+    free(spectrum);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ *  correlation.h
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef CORRELATION_H
+#define CORRELATION_H
+
+#include <stddef.h>
+
+// Finds where a known signal starts in a longer capture by cross-correlation.
+// Both are transformed with a radix-2 FFT padded to cover every lag, so the
+// cost grows with n log n of the capture length rather than with the product
+// of the two lengths.  Has no Core Audio dependency.
+//
+// outDelay receives the offset of the signal in the capture in samples and
+// outCorrelation the magnitude of the normalized correlation at that offset,
+// from 0 for no match to 1 for an exact, scaled copy of either polarity.
+// Returns 0 on success and -1 if the signal does not fit in the capture or
+// memory runs out.
+
+int findSignalDelay(const float * signal, size_t signalCount, const float * capture, size_t captureCount,
+                    size_t * outDelay, double * outCorrelation);
+
+#endif
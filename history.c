@@ -0,0 +1,253 @@
+/*
+ *  history.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "history.h"
+
+
+static ASHistoryFile * history = NULL;
+static bool historyChecked = false;
+static UInt32 historySource = kHistorySourceExternal;
+
+static void getHistoryPath(char * path, size_t pathSize) {
+    const char * override = getenv("SWITCHAUDIO_HISTORY");
+    const char * home = getenv("HOME");
+
+    if (override && override[0]) {
+        strlcpy(path, override, pathSize);
+    } else {
+        snprintf(path, pathSize, "%s/Library/Logs/SwitchAudioSource.history", home ? home : "/tmp");
+    }
+}
+
+static bool isValidHistory(ASHistoryFile * file) {
+    return file->magic == kHistoryMagic && file->version == kHistoryVersion
+        && file->capacity == kHistoryCapacity && file->recordSize == sizeof(ASHistoryRecord);
+}
+
+// maps the history file.  The history is enabled by the file existing, so
+// nothing is created unless create is set.
+static ASHistoryFile * mapHistory(bool create) {
+    char path[1024];
+    struct stat info;
+
+    getHistoryPath(path, sizeof(path));
+    int fd = open(path, O_RDWR | (create ? O_CREAT : 0), 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &info) != 0 || (info.st_size != sizeof(ASHistoryFile) && !create)) {
+        close(fd);
+        return NULL;
+    }
+    if (info.st_size != sizeof(ASHistoryFile) && ftruncate(fd, sizeof(ASHistoryFile)) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void * mapped = mmap(NULL, sizeof(ASHistoryFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    ASHistoryFile * file = (ASHistoryFile *)mapped;
+
+    // only enabling (re)initializes the file, under a lock so concurrent
+    // invocations agree on its contents
+    if (create && !isValidHistory(file)) {
+        flock(fd, LOCK_EX);
+        if (!isValidHistory(file)) {
+            memset(file, 0, sizeof(ASHistoryFile));
+            file->capacity = kHistoryCapacity;
+            file->recordSize = sizeof(ASHistoryRecord);
+            file->version = kHistoryVersion;
+            __atomic_store_n(&file->magic, kHistoryMagic, __ATOMIC_RELEASE);
+        }
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+
+    if (!isValidHistory(file)) {
+        munmap(mapped, sizeof(ASHistoryFile));
+        return NULL;
+    }
+    return file;
+}
+
+bool isHistoryEnabled(void) {
+    if (!historyChecked) {
+        history = mapHistory(false);
+        historyChecked = true;
+    }
+    return history != NULL;
+}
+
+int enableHistory(void) {
+    char path[1024];
+
+    getHistoryPath(path, sizeof(path));
+    history = mapHistory(true);
+    historyChecked = true;
+    if (history == NULL) {
+        printf("Could not create the history file \"%s\".\n", path);
+        return 1;
+    }
+    printf("history is recorded in \"%s\"\n", path);
+    return 0;
+}
+
+int disableHistory(void) {
+    char path[1024];
+
+    getHistoryPath(path, sizeof(path));
+    if (unlink(path) != 0 && errno != ENOENT) {
+        printf("Could not remove the history file \"%s\".\n", path);
+        return 1;
+    }
+    printf("history is disabled\n");
+    return 0;
+}
+
+void setHistorySource(UInt32 source) {
+    historySource = source;
+}
+
+static void copyUID(ASContext * context, AudioDeviceID deviceID, char * uid) {
+    char * deviceUID = NULL;
+
+    uid[0] = '\0';
+    if (deviceID != kAudioDeviceUnknown && ASCopyDeviceUID(context, deviceID, &deviceUID) == noErr) {
+        strlcpy(uid, deviceUID, kHistoryUIDLength);
+        free(deviceUID);
+    }
+}
+
+static void appendRecord(ASContext * context, ASDeviceType role, UInt32 source, AudioDeviceID oldDeviceID, AudioDeviceID newDeviceID) {
+    struct timespec now;
+    UInt64 index = __atomic_fetch_add(&history->head, 1, __ATOMIC_ACQ_REL);
+    ASHistoryRecord * record = &history->records[index % kHistoryCapacity];
+
+    // invalidate the slot before overwriting it so readers skip it until it is complete
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    record->timestamp = (UInt64)now.tv_sec * 1000000000ull + (UInt64)now.tv_nsec;
+    record->role = role;
+    record->source = source;
+    record->oldDeviceID = oldDeviceID;
+    record->newDeviceID = newDeviceID;
+    copyUID(context, oldDeviceID, record->oldDeviceUID);
+    copyUID(context, newDeviceID, record->newDeviceUID);
+
+    __atomic_store_n(&record->sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+void recordDeviceChange(ASContext * context, ASDeviceType role, AudioDeviceID oldDeviceID, AudioDeviceID newDeviceID) {
+    if (!isHistoryEnabled()) {
+        return;
+    }
+    if (role != kAudioTypeInput && role != kAudioTypeSystemOutput) {
+        role = kAudioTypeOutput;
+    }
+
+    // a different device than the one last recorded means something else switched it
+    AudioDeviceID lastDeviceID = __atomic_exchange_n(&history->lastDeviceID[role], newDeviceID, __ATOMIC_ACQ_REL);
+    if (lastDeviceID != kAudioDeviceUnknown && oldDeviceID != kAudioDeviceUnknown && lastDeviceID != oldDeviceID) {
+        appendRecord(context, role, kHistorySourceExternal, lastDeviceID, oldDeviceID);
+    }
+    appendRecord(context, role, historySource, oldDeviceID, newDeviceID);
+}
+
+static const char * historySourceName(UInt32 source) {
+    switch (source) {
+        case kHistorySourceExternal: return "external";
+        case kFunctionSetDeviceByName: return "name";
+        case kFunctionSetDeviceByID: return "id";
+        case kFunctionSetDeviceByUID: return "uid";
+        case kFunctionCycleNext: return "next";
+        case kFunctionCreateAggregate: return "aggregate";
+        default: return "unknown";
+    }
+}
+
+void showHistory(ASOutputType outputRequested) {
+    char timeString[32];
+    ASHistoryRecord record;
+
+    if (!isHistoryEnabled()) {
+        printf("History is not enabled.  Enable it with --history-enable.\n");
+        return;
+    }
+
+    UInt64 head = __atomic_load_n(&history->head, __ATOMIC_ACQUIRE);
+    UInt64 first = (head > kHistoryCapacity) ? head - kHistoryCapacity : 0;
+
+    for (UInt64 index = first; index < head; ++index) {
+        ASHistoryRecord * slot = &history->records[index % kHistoryCapacity];
+
+        // skip records that are incomplete or were overwritten while copying
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != index + 1) continue;
+        memcpy(&record, slot, sizeof(record));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != index + 1) continue;
+        record.oldDeviceUID[kHistoryUIDLength - 1] = '\0';
+        record.newDeviceUID[kHistoryUIDLength - 1] = '\0';
+
+        time_t seconds = (time_t)(record.timestamp / 1000000000ull);
+        unsigned milliseconds = (unsigned)((record.timestamp / 1000000ull) % 1000);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        strftime(timeString, sizeof(timeString), "%Y-%m-%d %H:%M:%S", &local);
+
+        switch (outputRequested) {
+            case kFormatHuman:
+                printf("%s.%03u %s: %u (%s) -> %u (%s) by %s\n", timeString, milliseconds, ASDeviceTypeName(record.role),
+                       record.oldDeviceID, record.oldDeviceUID, record.newDeviceID, record.newDeviceUID, historySourceName(record.source));
+                break;
+            case kFormatCLI:
+                printf("%llu,%s,%u,%s,%u,%s,%s\n", (unsigned long long)(record.timestamp / 1000000ull), ASDeviceTypeName(record.role),
+                       record.oldDeviceID, record.oldDeviceUID, record.newDeviceID, record.newDeviceUID, historySourceName(record.source));
+                break;
+            case kFormatJSON:
+                printf("{\"time\": \"%s.%03u\", \"timestamp\": \"%llu\", \"type\": \"%s\", \"old_id\": \"%u\", \"old_uid\": \"%s\", \"new_id\": \"%u\", \"new_uid\": \"%s\", \"source\": \"%s\"}\n",
+                       timeString, milliseconds, (unsigned long long)(record.timestamp / 1000000ull), ASDeviceTypeName(record.role),
+                       record.oldDeviceID, record.oldDeviceUID, record.newDeviceID, record.newDeviceUID, historySourceName(record.source));
+                break;
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ *  history.h
+ *  AudioSwitcher
+ *
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ *
+ */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "audio_switch.h"
+
+// The history is an opt-in, fixed size ring of records in a memory-mapped
+// file.  Records are claimed with an atomic increment of the head and marked
+// complete by storing their sequence number last, so appending never takes a
+// lock and a record torn by a crash is skipped when reading.
+
+#define kHistoryMagic     'SAhs'
+#define kHistoryVersion   1
+#define kHistoryCapacity  1024
+#define kHistoryUIDLength 128
+
+// records not initiated by a command are external changes, detected the next
+// time the role is switched by this tool
+#define kHistorySourceExternal 0
+
+typedef struct {
+	UInt64 sequence;        // record index + 1 once complete, 0 while being written
+	UInt64 timestamp;       // nanoseconds since 1970
+	UInt32 role;            // ASDeviceType
+	UInt32 source;          // kFunction* of the initiating command or kHistorySourceExternal
+	AudioDeviceID oldDeviceID;
+	AudioDeviceID newDeviceID;
+	char oldDeviceUID[kHistoryUIDLength];
+	char newDeviceUID[kHistoryUIDLength];
+} ASHistoryRecord;
+
+typedef struct {
+	UInt32 magic;
+	UInt32 version;
+	UInt32 capacity;
+	UInt32 recordSize;
+	UInt64 head;                                   // index of the next record
+	AudioDeviceID lastDeviceID[kAudioTypeAll + 1]; // last recorded device, by ASDeviceType
+	ASHistoryRecord records[kHistoryCapacity];
+} ASHistoryFile;
+
+bool isHistoryEnabled(void);
+int enableHistory(void);
+int disableHistory(void);
+void setHistorySource(UInt32 source);
+void recordDeviceChange(ASContext * context, ASDeviceType role, AudioDeviceID oldDeviceID, AudioDeviceID newDeviceID);
+void showHistory(ASOutputType outputRequested);
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ *  latency.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#include <math.h>
+#include <time.h>
+#include "correlation.h"
+#include "latency.h"
+
+
+#define kLatencyFadeFrames 64
+
+// latency properties of one direction of a device, in frames
+typedef struct {
+    UInt32 latency;
+    UInt32 safetyOffset;
+    UInt32 streamLatency;
+    UInt32 bufferFrames;
+} ASDeviceLatency;
+
+static UInt32 getFrames(AudioObjectID objectID, AudioObjectPropertySelector selector, AudioObjectPropertyScope scope) {
+    AudioObjectPropertyAddress address = {selector, scope, kAudioObjectPropertyElementMaster};
+    UInt32 frames = 0;
+    UInt32 dataSize = sizeof(frames);
+
+    if (AudioObjectGetPropertyData(objectID, &address, 0, NULL, &dataSize, &frames) != noErr) {
+        return 0;
+    }
+    return frames;
+}
+
+static void getDeviceLatency(AudioDeviceID deviceID, AudioObjectPropertyScope scope, ASDeviceLatency * latency) {
+    AudioObjectPropertyAddress address = {kAudioDevicePropertyStreams, scope, kAudioObjectPropertyElementMaster};
+    AudioObjectID streamID = kAudioObjectUnknown;
+    UInt32 dataSize = sizeof(streamID);
+
+    latency->latency = getFrames(deviceID, kAudioDevicePropertyLatency, scope);
+    latency->safetyOffset = getFrames(deviceID, kAudioDevicePropertySafetyOffset, scope);
+    latency->bufferFrames = getFrames(deviceID, kAudioDevicePropertyBufferFrameSize, kAudioObjectPropertyScopeGlobal);
+
+    // the first stream stands for the device
+    latency->streamLatency = 0;
+    if (AudioObjectGetPropertyData(deviceID, &address, 0, NULL, &dataSize, &streamID) == noErr && dataSize >= sizeof(streamID)) {
+        latency->streamLatency = getFrames(streamID, kAudioStreamPropertyLatency, kAudioObjectPropertyScopeGlobal);
+    }
+}
+
+static Float64 getSampleRate(AudioDeviceID deviceID) {
+    AudioObjectPropertyAddress address = {kAudioDevicePropertyNominalSampleRate, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+    Float64 sampleRate = 0.0;
+    UInt32 dataSize = sizeof(sampleRate);
+
+    if (AudioObjectGetPropertyData(deviceID, &address, 0, NULL, &dataSize, &sampleRate) != noErr) {
+        return 0.0;
+    }
+    return sampleRate;
+}
+
+// white noise from a fixed seed, faded in and out to avoid clicks
+static void makeTestSignal(float * signal, UInt32 count) {
+    UInt32 state = 0x9e3779b9;
+    for (UInt32 i = 0; i < count; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        float gain = kLatencyAmplitude;
+        if (i < kLatencyFadeFrames) gain *= (float)i / kLatencyFadeFrames;
+        if (count - i <= kLatencyFadeFrames) gain *= (float)(count - i - 1) / kLatencyFadeFrames;
+        signal[i] = ((float)(state >> 8) / (float)(1 << 23) - 1.0f) * gain;
+    }
+}
+
+// plays the signal once on every output channel, then silence; the signal
+// starts with the first buffer whose host time is valid
+static OSStatus playIOProc(AudioObjectID deviceID, const AudioTimeStamp * now, const AudioBufferList * inputData, const AudioTimeStamp * inputTime,
+                           AudioBufferList * outputData, const AudioTimeStamp * outputTime, void * clientData) {
+    ASLatencyRun * run = (ASLatencyRun *)clientData;
+    UInt32 played = run->played;
+    UInt32 frames = 0;
+    bool started = played > 0 || (outputTime->mFlags & kAudioTimeStampHostTimeValid) != 0;
+
+    if (played == 0 && started) {
+        __atomic_store_n(&run->signalHostTime, outputTime->mHostTime, __ATOMIC_RELEASE);
+    }
+    for (UInt32 i = 0; i < outputData->mNumberBuffers; ++i) {
+        AudioBuffer * buffer = &outputData->mBuffers[i];
+        UInt32 stride = buffer->mNumberChannels;
+        if (stride == 0 || buffer->mData == NULL) {
+            continue;
+        }
+        float * samples = (float *)buffer->mData;
+        UInt32 bufferFrames = buffer->mDataByteSize / (UInt32)(sizeof(float) * stride);
+        if (bufferFrames > frames) frames = bufferFrames;
+
+        for (UInt32 f = 0; f < bufferFrames; ++f) {
+            float value = started && played + f < run->signalCount ? run->signal[played + f] : 0.0f;
+            for (UInt32 c = 0; c < stride; ++c) {
+                samples[(size_t)f * stride + c] = value;
+            }
+        }
+    }
+    if (started) {
+        played = played + frames < run->signalCount ? played + frames : run->signalCount;
+        __atomic_store_n(&run->played, played, __ATOMIC_RELEASE);
+    }
+    return noErr;
+}
+
+// captures the average of all input channels until the capture is full,
+// starting with the first buffer whose host time is valid
+static OSStatus captureIOProc(AudioObjectID deviceID, const AudioTimeStamp * now, const AudioBufferList * inputData, const AudioTimeStamp * inputTime,
+                              AudioBufferList * outputData, const AudioTimeStamp * outputTime, void * clientData) {
+    ASLatencyRun * run = (ASLatencyRun *)clientData;
+    UInt32 captured = run->captured;
+    UInt32 channels = 0;
+    UInt32 frames = 0;
+
+    if (captured >= run->captureCapacity) {
+        return noErr;
+    }
+    if (captured == 0) {
+        if ((inputTime->mFlags & kAudioTimeStampHostTimeValid) == 0) {
+            return noErr;
+        }
+        run->captureHostTime = inputTime->mHostTime;
+    }
+
+    float * capture = run->capture + captured;
+    for (UInt32 i = 0; i < inputData->mNumberBuffers; ++i) {
+        const AudioBuffer * buffer = &inputData->mBuffers[i];
+        UInt32 stride = buffer->mNumberChannels;
+        if (stride == 0 || buffer->mData == NULL) {
+            continue;
+        }
+        const float * samples = (const float *)buffer->mData;
+        UInt32 bufferFrames = buffer->mDataByteSize / (UInt32)(sizeof(float) * stride);
+        if (bufferFrames > run->captureCapacity - captured) bufferFrames = run->captureCapacity - captured;
+        if (bufferFrames > frames) {
+            memset(capture + frames, 0, (bufferFrames - frames) * sizeof(float));
+            frames = bufferFrames;
+        }
+
+        for (UInt32 f = 0; f < bufferFrames; ++f) {
+            for (UInt32 c = 0; c < stride; ++c) {
+                capture[f] += samples[(size_t)f * stride + c];
+            }
+        }
+        channels += stride;
+    }
+    for (UInt32 f = 0; f < frames; ++f) {
+        capture[f] /= (float)channels;
+    }
+
+    __atomic_store_n(&run->captured, captured + frames, __ATOMIC_RELEASE);
+    return noErr;
+}
+
+// waits until a frame counter published by an IOProc reaches frames
+static bool waitForFrames(const UInt32 * counter, UInt32 frames) {
+    struct timespec pause = {0, 5000000};
+    for (double waited = 0.0; waited < kLatencyTimeoutSeconds; waited += 0.005) {
+        if (__atomic_load_n(counter, __ATOMIC_ACQUIRE) >= frames) {
+            return true;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return false;
+}
+
+static void showLatency(ASContext * context, AudioDeviceID outputDeviceID, AudioDeviceID inputDeviceID, double measured, double correlation,
+                        Float64 sampleRate, const ASDeviceLatency * output, const ASDeviceLatency * input, ASOutputType outputRequested) {
+    double reported = (double)(output->latency + output->safetyOffset + output->streamLatency
+                               + input->latency + input->safetyOffset + input->streamLatency) * 1000.0 / sampleRate;
+    char * outputName = NULL;
+    char * inputName = NULL;
+
+    switch (outputRequested) {
+        case kFormatHuman:
+            ASCopyDeviceName(context, outputDeviceID, &outputName);
+            ASCopyDeviceName(context, inputDeviceID, &inputName);
+            printf("Round-trip latency from \"%s\" to \"%s\": %.1f ms (correlation %.2f)\n",
+                   outputName ? outputName : "", inputName ? inputName : "", measured, correlation);
+            printf("Reported by the devices: %.1f ms at %.0f Hz\n", reported, sampleRate);
+            printf("  output: latency %u, safety offset %u, stream latency %u, buffer %u frames\n",
+                   output->latency, output->safetyOffset, output->streamLatency, output->bufferFrames);
+            printf("  input:  latency %u, safety offset %u, stream latency %u, buffer %u frames\n",
+                   input->latency, input->safetyOffset, input->streamLatency, input->bufferFrames);
+            free(outputName);
+            free(inputName);
+            break;
+        case kFormatCLI:
+            printf("%.2f,%.2f,%.0f,%.2f,%u,%u,%u,%u,%u,%u,%u,%u\n", measured, reported, sampleRate, correlation,
+                   output->latency, output->safetyOffset, output->streamLatency, output->bufferFrames,
+                   input->latency, input->safetyOffset, input->streamLatency, input->bufferFrames);
+            break;
+        case kFormatJSON:
+            printf("{\"measured_ms\": \"%.2f\", \"reported_ms\": \"%.2f\", \"sample_rate\": \"%.0f\", \"correlation\": \"%.2f\", "
+                   "\"output\": {\"id\": \"%u\", \"latency\": \"%u\", \"safety_offset\": \"%u\", \"stream_latency\": \"%u\", \"buffer\": \"%u\"}, "
+                   "\"input\": {\"id\": \"%u\", \"latency\": \"%u\", \"safety_offset\": \"%u\", \"stream_latency\": \"%u\", \"buffer\": \"%u\"}}\n",
+                   measured, reported, sampleRate, correlation,
+                   outputDeviceID, output->latency, output->safetyOffset, output->streamLatency, output->bufferFrames,
+                   inputDeviceID, input->latency, input->safetyOffset, input->streamLatency, input->bufferFrames);
+            break;
+        default:
+            break;
+    }
+}
+
+// plays the signal while capturing the input; both IOProcs are gone on return
+static int captureTestSignal(ASLatencyRun * run, AudioDeviceID outputDeviceID, AudioDeviceID inputDeviceID) {
+    AudioDeviceIOProcID playProcID = NULL;
+    AudioDeviceIOProcID captureProcID = NULL;
+    int result = 1;
+
+    OSStatus status = AudioDeviceCreateIOProcID(inputDeviceID, captureIOProc, run, &captureProcID);
+    if (status == noErr) {
+        status = AudioDeviceCreateIOProcID(outputDeviceID, playIOProc, run, &playProcID);
+    }
+    // capture first so the start of the capture precedes the signal
+    if (status == noErr) {
+        status = AudioDeviceStart(inputDeviceID, captureProcID);
+    }
+    if (status == noErr && waitForFrames(&run->captured, 1)) {
+        status = AudioDeviceStart(outputDeviceID, playProcID);
+        if (status == noErr) {
+            // the window is counted from the start of the signal, not of the capture
+            UInt32 startupCapacity = run->captureCapacity - run->windowCount;
+            if (!waitForFrames(&run->played, 1)) {
+                printf("The output device did not play any time stamped audio.\n");
+            } else if (__atomic_load_n(&run->captured, __ATOMIC_ACQUIRE) > startupCapacity) {
+                printf("The output device took longer than %.1f s to start.\n", kLatencyStartupSeconds);
+            } else if (!waitForFrames(&run->captured, __atomic_load_n(&run->captured, __ATOMIC_ACQUIRE) + run->windowCount)) {
+                printf("Timed out while capturing the test signal.\n");
+            } else {
+                result = 0;
+            }
+        }
+    } else if (status == noErr) {
+        printf("The input device did not deliver any time stamped audio.\n");
+    }
+    if (status != noErr) {
+        printf("Failed to start the audio devices. Error: %d (%s)\n", status, statusErrorString(status));
+    }
+
+    if (playProcID != NULL) {
+        AudioDeviceStop(outputDeviceID, playProcID);
+        AudioDeviceDestroyIOProcID(outputDeviceID, playProcID);
+    }
+    if (captureProcID != NULL) {
+        AudioDeviceStop(inputDeviceID, captureProcID);
+        AudioDeviceDestroyIOProcID(inputDeviceID, captureProcID);
+    }
+    return result;
+}
+
+static int measureCapturedLatency(ASContext * context, ASLatencyRun * run, AudioDeviceID outputDeviceID, AudioDeviceID inputDeviceID,
+                                  Float64 sampleRate, ASOutputType outputRequested) {
+    ASDeviceLatency outputLatency, inputLatency;
+    size_t delay = 0;
+    double correlation = 0.0;
+
+    // the capture IOProc is stopped, so the count no longer changes
+    if (findSignalDelay(run->signal, run->signalCount, run->capture, run->captured, &delay, &correlation) != 0) {
+        return 1;
+    }
+    if (correlation < kLatencyMinCorrelation) {
+        printf("The test signal was not found in the capture.  Check that the input can hear the output.\n");
+        return 1;
+    }
+
+    // both host times refer to the first frame of their buffer
+    double measured = ((double)AudioConvertHostTimeToNanos(run->captureHostTime) - (double)AudioConvertHostTimeToNanos(run->signalHostTime)) / 1e6
+                      + (double)delay * 1000.0 / sampleRate;
+    getDeviceLatency(outputDeviceID, kAudioDevicePropertyScopeOutput, &outputLatency);
+    getDeviceLatency(inputDeviceID, kAudioDevicePropertyScopeInput, &inputLatency);
+    showLatency(context, outputDeviceID, inputDeviceID, measured, correlation, sampleRate, &outputLatency, &inputLatency, outputRequested);
+    return 0;
+}
+
+int runLatencyMeasurement(ASContext * context, AudioDeviceID outputDeviceID, AudioDeviceID inputDeviceID, ASOutputType outputRequested) {
+    int result = 1;
+
+    Float64 sampleRate = getSampleRate(outputDeviceID);
+    Float64 inputSampleRate = getSampleRate(inputDeviceID);
+    if (sampleRate <= 0.0 || sampleRate != inputSampleRate) {
+        printf("The sample rates of the output device (%.0f Hz) and the input device (%.0f Hz) must match.\n", sampleRate, inputSampleRate);
+        return 1;
+    }
+
+    ASLatencyRun * run = (ASLatencyRun *)calloc(1, sizeof(ASLatencyRun));
+    if (run == NULL) {
+        return 1;
+    }
+    run->signalCount = (UInt32)(sampleRate * kLatencySignalSeconds);
+    run->windowCount = run->signalCount + (UInt32)(sampleRate * kLatencyWindowSeconds);
+    run->captureCapacity = run->windowCount + (UInt32)(sampleRate * kLatencyStartupSeconds);
+    float * signal = (float *)malloc(run->signalCount * sizeof(float));
+    run->capture = (float *)calloc(run->captureCapacity, sizeof(float));
+
+    if (signal != NULL && run->capture != NULL) {
+        makeTestSignal(signal, run->signalCount);
+        run->signal = signal;
+        if (captureTestSignal(run, outputDeviceID, inputDeviceID) == 0) {
+            result = measureCapturedLatency(context, run, outputDeviceID, inputDeviceID, sampleRate, outputRequested);
+        }
+    }
+
+    free(signal);
+    free(run->capture);
+    free(run);
+    return result;
+}
@@ -0,0 +1,63 @@
+/*
+ *  latency.h
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "audio_switch.h"
+
+// Round-trip latency measurement.  A noise burst is played on the output
+// device while the input device is captured; the burst is found in the
+// capture by cross-correlation and the HAL host time stamps of both IOProcs
+// turn the offset into the time from playing a sample to capturing it.
+
+#define kLatencySignalSeconds   0.2    // length of the noise burst
+#define kLatencyWindowSeconds   1.0    // longest round trip that can be measured
+#define kLatencyStartupSeconds  1.0    // longest the output may take to start playing
+#define kLatencyTimeoutSeconds  5.0
+#define kLatencyAmplitude       0.25f  // -12 dBFS
+#define kLatencyMinCorrelation  0.1
+
+typedef struct {
+	// written by the output IOProc
+	const float * signal;
+	UInt32 signalCount;
+	UInt32 played;               // signal frames written so far
+	UInt64 signalHostTime;       // host time the first signal frame is played
+
+	// written by the input IOProc
+	float * capture;
+	UInt32 captureCapacity;      // startup time, then windowCount
+	UInt32 windowCount;          // frames captured once the signal is playing
+	UInt32 captured;             // frames captured so far, published with release
+	UInt64 captureHostTime;      // host time the first captured frame was sampled
+} ASLatencyRun;
+
+int runLatencyMeasurement(ASContext * context, AudioDeviceID outputDeviceID, AudioDeviceID inputDeviceID, ASOutputType outputRequested);
+
+#endif
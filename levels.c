@@ -0,0 +1,215 @@
+/*
+ *  levels.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "levels.h"
+
+
+typedef float ASFloat4 __attribute__((vector_size(16)));
+typedef int32_t ASInt4 __attribute__((vector_size(16)));
+
+// samples of a Core Audio buffer are only guaranteed to be float aligned
+static inline ASFloat4 loadFloat4(const float * samples) {
+    ASFloat4 value;
+    memcpy(&value, samples, sizeof(value));
+    return value;
+}
+
+static inline ASFloat4 absFloat4(ASFloat4 value) {
+    const ASInt4 mask = {0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff};
+    return (ASFloat4)((ASInt4)value & mask);
+}
+
+static inline ASFloat4 maxFloat4(ASFloat4 a, ASFloat4 b) {
+    ASInt4 greater = (ASInt4)(a > b);
+    return (ASFloat4)(((ASInt4)a & greater) | ((ASInt4)b & ~greater));
+}
+
+void accumulateLevels(const float * samples, size_t count, float * peak, float * sumOfSquares) {
+    // four independent accumulators hide the latency of the adds
+    ASFloat4 peak0 = {0}, peak1 = {0}, peak2 = {0}, peak3 = {0};
+    ASFloat4 sum0 = {0}, sum1 = {0}, sum2 = {0}, sum3 = {0};
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        ASFloat4 a = loadFloat4(samples + i);
+        ASFloat4 b = loadFloat4(samples + i + 4);
+        ASFloat4 c = loadFloat4(samples + i + 8);
+        ASFloat4 d = loadFloat4(samples + i + 12);
+        peak0 = maxFloat4(peak0, absFloat4(a));
+        peak1 = maxFloat4(peak1, absFloat4(b));
+        peak2 = maxFloat4(peak2, absFloat4(c));
+        peak3 = maxFloat4(peak3, absFloat4(d));
+        sum0 += a * a;
+        sum1 += b * b;
+        sum2 += c * c;
+        sum3 += d * d;
+    }
+    for (; i + 4 <= count; i += 4) {
+        ASFloat4 a = loadFloat4(samples + i);
+        peak0 = maxFloat4(peak0, absFloat4(a));
+        sum0 += a * a;
+    }
+
+    ASFloat4 peakAll = maxFloat4(maxFloat4(peak0, peak1), maxFloat4(peak2, peak3));
+    ASFloat4 sumAll = (sum0 + sum1) + (sum2 + sum3);
+    float resultPeak = *peak;
+    float resultSum = 0.0f;
+    for (int lane = 0; lane < 4; ++lane) {
+        if (peakAll[lane] > resultPeak) resultPeak = peakAll[lane];
+        resultSum += sumAll[lane];
+    }
+    for (; i < count; ++i) {
+        float sample = samples[i];
+        if (fabsf(sample) > resultPeak) resultPeak = fabsf(sample);
+        resultSum += sample * sample;
+    }
+
+    *peak = resultPeak;
+    *sumOfSquares += resultSum;
+}
+
+// A block is the fewest whole frames that fill whole vectors, so every lane
+// sees the same channel in every block.  The vectors are spelled out so that
+// with a constant count the accumulators stay in registers.
+#define accumulateVector(v) \
+    if (vectors > v) { \
+        ASFloat4 a = loadFloat4(samples + 4 * v); \
+        peak##v = maxFloat4(peak##v, absFloat4(a)); \
+        sum##v += a * a; \
+    }
+
+static inline __attribute__((always_inline)) void accumulateBlocks(const float * samples, size_t blocks, int vectors, ASFloat4 * peaks, ASFloat4 * sums) {
+    ASFloat4 peak0 = {0}, peak1 = {0}, peak2 = {0}, peak3 = {0}, peak4 = {0}, peak5 = {0}, peak6 = {0};
+    ASFloat4 sum0 = {0}, sum1 = {0}, sum2 = {0}, sum3 = {0}, sum4 = {0}, sum5 = {0}, sum6 = {0};
+
+    for (size_t b = 0; b < blocks; ++b, samples += 4 * vectors) {
+        accumulateVector(0) accumulateVector(1) accumulateVector(2) accumulateVector(3)
+        accumulateVector(4) accumulateVector(5) accumulateVector(6)
+    }
+
+    const ASFloat4 blockPeaks[] = {peak0, peak1, peak2, peak3, peak4, peak5, peak6};
+    const ASFloat4 blockSums[] = {sum0, sum1, sum2, sum3, sum4, sum5, sum6};
+    memcpy(peaks, blockPeaks, sizeof(blockPeaks));
+    memcpy(sums, blockSums, sizeof(blockSums));
+}
+
+#undef accumulateVector
+
+static void accumulateStridedLevels(const float * restrict samples, size_t frames, unsigned stride, unsigned channels, float * restrict peaks, float * restrict sumsOfSquares) {
+    for (size_t f = 0; f < frames; ++f, samples += stride) {
+        for (unsigned c = 0; c < channels; ++c) {
+            float sample = samples[c];
+            if (fabsf(sample) > peaks[c]) peaks[c] = fabsf(sample);
+            sumsOfSquares[c] += sample * sample;
+        }
+    }
+}
+
+// wide frames are read four neighbouring channels at a time, two frames per
+// step so that the adds of one frame do not wait for the other
+static void accumulateWideLevels(const float * samples, size_t frames, unsigned stride, unsigned channels, float * peaks, float * sumsOfSquares) {
+    unsigned c = 0;
+
+    for (; c + 4 <= channels; c += 4) {
+        ASFloat4 peak0 = {0}, peak1 = {0};
+        ASFloat4 sum0 = {0}, sum1 = {0};
+        const float * source = samples + c;
+        size_t f = 0;
+        for (; f + 2 <= frames; f += 2, source += 2 * (size_t)stride) {
+            ASFloat4 a = loadFloat4(source);
+            ASFloat4 b = loadFloat4(source + stride);
+            peak0 = maxFloat4(peak0, absFloat4(a));
+            peak1 = maxFloat4(peak1, absFloat4(b));
+            sum0 += a * a;
+            sum1 += b * b;
+        }
+        if (f < frames) {
+            ASFloat4 a = loadFloat4(source);
+            peak0 = maxFloat4(peak0, absFloat4(a));
+            sum0 += a * a;
+        }
+        ASFloat4 peakAll = maxFloat4(peak0, peak1);
+        ASFloat4 sumAll = sum0 + sum1;
+        for (int lane = 0; lane < 4; ++lane) {
+            if (peakAll[lane] > peaks[c + lane]) peaks[c + lane] = peakAll[lane];
+            sumsOfSquares[c + lane] += sumAll[lane];
+        }
+    }
+    accumulateStridedLevels(samples + c, frames, stride, channels - c, peaks + c, sumsOfSquares + c);
+}
+
+void accumulateInterleavedLevels(const float * samples, size_t frames, unsigned stride, unsigned channels, float * peaks, float * sumsOfSquares) {
+    if (channels > stride) channels = stride;
+    if (stride == 1) {
+        if (channels == 1) accumulateLevels(samples, frames, peaks, sumsOfSquares);
+        return;
+    }
+    if (stride > kLevelsMaxVectorStride) {
+        accumulateWideLevels(samples, frames, stride, channels, peaks, sumsOfSquares);
+        return;
+    }
+
+    // 4 / gcd(stride, 4) frames fill stride / gcd(stride, 4) vectors; at
+    // least four vectors per block keep enough adds in flight
+    unsigned divisor = (stride % 4 == 0) ? 4 : (stride % 2 == 0) ? 2 : 1;
+    unsigned blockFrames = 4 / divisor;
+    int vectors = (int)(stride / divisor);
+    while (vectors < 4) {
+        vectors *= 2;
+        blockFrames *= 2;
+    }
+    size_t blocks = frames / blockFrames;
+    ASFloat4 blockPeaks[kLevelsMaxVectorStride] = {{0}};
+    ASFloat4 blockSums[kLevelsMaxVectorStride] = {{0}};
+
+    // four to seven vectors, each count gets its own copy of the loop
+    switch (vectors) {
+        case 4: accumulateBlocks(samples, blocks, 4, blockPeaks, blockSums); break;
+        case 5: accumulateBlocks(samples, blocks, 5, blockPeaks, blockSums); break;
+        case 6: accumulateBlocks(samples, blocks, 6, blockPeaks, blockSums); break;
+        case 7: accumulateBlocks(samples, blocks, 7, blockPeaks, blockSums); break;
+    }
+
+    float stridePeaks[kLevelsMaxVectorStride] = {0};
+    float strideSums[kLevelsMaxVectorStride] = {0};
+    for (int v = 0; v < vectors; ++v) {
+        for (int lane = 0; lane < 4; ++lane) {
+            unsigned c = (unsigned)(4 * v + lane) % stride;
+            if (blockPeaks[v][lane] > stridePeaks[c]) stridePeaks[c] = blockPeaks[v][lane];
+            strideSums[c] += blockSums[v][lane];
+        }
+    }
+    for (unsigned c = 0; c < channels; ++c) {
+        if (stridePeaks[c] > peaks[c]) peaks[c] = stridePeaks[c];
+        sumsOfSquares[c] += strideSums[c];
+    }
+    accumulateStridedLevels(samples + blocks * blockFrames * stride, frames - blocks * blockFrames, stride, channels, peaks, sumsOfSquares);
+}
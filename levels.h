@@ -0,0 +1,50 @@
+/*
+ *  levels.h
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef LEVELS_H
+#define LEVELS_H
+
+#include <stddef.h>
+
+// Peak and sum of squares of one channel of float samples.  The kernel uses
+// the compiler's generic vector extensions, which become SSE on Intel and
+// NEON on Apple silicon, and has no Core Audio dependency.  peak and
+// sumOfSquares are accumulated into, so a channel can be fed in pieces.
+
+void accumulateLevels(const float * samples, size_t count, float * peak, float * sumOfSquares);
+
+// The same for the first channels of frames interleaved stride samples apart,
+// reduced in place.  Up to kLevelsMaxVectorStride channels, the vector lanes
+// follow the channels through the frames; wider frames are read four
+// neighbouring channels at a time.  peaks and sumsOfSquares hold channels
+// entries.
+#define kLevelsMaxVectorStride 8
+
+void accumulateInterleavedLevels(const float * samples, size_t frames, unsigned stride, unsigned channels, float * peaks, float * sumsOfSquares);
+
+#endif
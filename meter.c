@@ -0,0 +1,243 @@
+/*
+ *  meter.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include "levels.h"
+#include "meter.h"
+
+
+#define kMeterBarWidth       40
+#define kMeterBarFloor       -60.0
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int signalNumber) {
+    stopRequested = 1;
+}
+
+// HAL IOProcs always deliver native float samples; a buffer holds one or
+// more interleaved channels, and channels are numbered across all buffers
+static OSStatus meterIOProc(AudioObjectID deviceID, const AudioTimeStamp * now, const AudioBufferList * inputData, const AudioTimeStamp * inputTime,
+                            AudioBufferList * outputData, const AudioTimeStamp * outputTime, void * clientData) {
+    ASMeter * meter = (ASMeter *)clientData;
+    UInt32 sequence = meter->sequence;
+    UInt32 generation = __atomic_load_n(&meter->resetGeneration, __ATOMIC_ACQUIRE);
+    UInt32 channel = 0;
+    UInt32 frames = 0;
+
+    __atomic_store_n(&meter->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (generation != meter->seenGeneration) {
+        memset(meter->peaks, 0, sizeof(meter->peaks));
+        memset(meter->sumsOfSquares, 0, sizeof(meter->sumsOfSquares));
+        meter->frames = 0;
+        meter->seenGeneration = generation;
+    }
+
+    for (UInt32 i = 0; i < inputData->mNumberBuffers; ++i) {
+        const AudioBuffer * buffer = &inputData->mBuffers[i];
+        UInt32 stride = buffer->mNumberChannels;
+        if (stride == 0 || buffer->mData == NULL) {
+            continue;
+        }
+        const float * samples = (const float *)buffer->mData;
+        UInt32 bufferFrames = buffer->mDataByteSize / (UInt32)(sizeof(float) * stride);
+        if (bufferFrames > frames) frames = bufferFrames;
+
+        if (channel >= kMeterMaxChannels) {
+            continue;
+        }
+
+        // interleaved frames are reduced where they are, without copying out the channels
+        UInt32 channels = kMeterMaxChannels - channel < stride ? kMeterMaxChannels - channel : stride;
+        float sumsOfSquares[kMeterMaxChannels] = {0};
+        accumulateInterleavedLevels(samples, bufferFrames, stride, channels, &meter->peaks[channel], sumsOfSquares);
+        for (UInt32 c = 0; c < channels; ++c) {
+            meter->sumsOfSquares[channel + c] += sumsOfSquares[c];
+        }
+        channel += channels;
+    }
+    meter->channelCount = channel;
+    meter->frames += frames;
+
+    __atomic_store_n(&meter->sequence, sequence + 2, __ATOMIC_RELEASE);
+    return noErr;
+}
+
+// copies the levels of the current interval and starts the next one; frames
+// delivered between the copy and the reset are dropped from both intervals
+static void readLevels(ASMeter * meter, UInt32 * channelCount, UInt64 * frames, float * peaks, double * sumsOfSquares) {
+    UInt32 before, after;
+    do {
+        while ((before = __atomic_load_n(&meter->sequence, __ATOMIC_ACQUIRE)) & 1) {
+            // the IOProc is in the middle of an update
+        }
+        *channelCount = meter->channelCount;
+        *frames = meter->frames;
+        memcpy(peaks, meter->peaks, sizeof(meter->peaks));
+        memcpy(sumsOfSquares, meter->sumsOfSquares, sizeof(meter->sumsOfSquares));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&meter->sequence, __ATOMIC_RELAXED);
+    } while (before != after);
+
+    __atomic_fetch_add(&meter->resetGeneration, 1, __ATOMIC_RELEASE);
+}
+
+static double toDecibels(double level) {
+    double decibels = level > 0.0 ? 20.0 * log10(level) : kMeterFloorDecibels;
+    return decibels < kMeterFloorDecibels ? kMeterFloorDecibels : decibels;
+}
+
+static UInt32 inputChannelCount(AudioDeviceID deviceID) {
+    AudioObjectPropertyAddress address = {kAudioDevicePropertyStreamConfiguration, kAudioDevicePropertyScopeInput, kAudioObjectPropertyElementMaster};
+    UInt32 dataSize = 0;
+    UInt32 channels = 0;
+
+    if (AudioObjectGetPropertyDataSize(deviceID, &address, 0, NULL, &dataSize) != noErr || dataSize == 0) {
+        return 0;
+    }
+    AudioBufferList * bufferList = (AudioBufferList *)malloc(dataSize);
+    if (bufferList == NULL) {
+        return 0;
+    }
+    if (AudioObjectGetPropertyData(deviceID, &address, 0, NULL, &dataSize, bufferList) == noErr) {
+        for (UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
+            channels += bufferList->mBuffers[i].mNumberChannels;
+        }
+    }
+    free(bufferList);
+    return channels;
+}
+
+static void showLevels(UInt32 channelCount, UInt64 frames, const float * peaks, const double * sumsOfSquares, double elapsed, UInt32 shownLines, ASOutputType outputRequested) {
+    switch (outputRequested) {
+        case kFormatHuman:
+            if (shownLines > 0) {
+                // move back up over the previous bars
+                printf("\033[%uA", shownLines);
+            }
+            for (UInt32 i = 0; i < channelCount; ++i) {
+                double peak = toDecibels(peaks[i]);
+                double rms = toDecibels(frames > 0 ? sqrt(sumsOfSquares[i] / frames) : 0.0);
+                int rmsWidth = (int)((rms - kMeterBarFloor) / -kMeterBarFloor * kMeterBarWidth);
+                int peakPosition = (int)((peak - kMeterBarFloor) / -kMeterBarFloor * kMeterBarWidth);
+                char bar[kMeterBarWidth + 1];
+                for (int x = 0; x < kMeterBarWidth; ++x) {
+                    bar[x] = x < rmsWidth ? '#' : (x == peakPosition - 1 ? '|' : ' ');
+                }
+                bar[kMeterBarWidth] = '\0';
+                printf("%2u [%s] peak %6.1f dB  rms %6.1f dB\033[K\n", i + 1, bar, peak, rms);
+            }
+            break;
+        case kFormatCLI:
+            printf("%.3f", elapsed);
+            for (UInt32 i = 0; i < channelCount; ++i) {
+                printf(",%.1f,%.1f", toDecibels(peaks[i]), toDecibels(frames > 0 ? sqrt(sumsOfSquares[i] / frames) : 0.0));
+            }
+            printf("\n");
+            break;
+        case kFormatJSON:
+            printf("{\"time\": \"%.3f\", \"frames\": \"%llu\", \"channels\": [", elapsed, (unsigned long long)frames);
+            for (UInt32 i = 0; i < channelCount; ++i) {
+                printf("%s{\"peak\": \"%.1f\", \"rms\": \"%.1f\"}", i > 0 ? ", " : "",
+                       toDecibels(peaks[i]), toDecibels(frames > 0 ? sqrt(sumsOfSquares[i] / frames) : 0.0));
+            }
+            printf("]}\n");
+            break;
+        default:
+            break;
+    }
+    fflush(stdout);
+}
+
+int runMeter(ASContext * context, AudioDeviceID deviceID, UInt32 intervalMilliseconds, ASOutputType outputRequested) {
+    AudioDeviceIOProcID procID = NULL;
+    char * deviceName = NULL;
+    float peaks[kMeterMaxChannels];
+    double sumsOfSquares[kMeterMaxChannels];
+    UInt32 channelCount = 0;
+    UInt64 frames = 0;
+    UInt32 shownLines = 0;
+
+    UInt32 deviceChannels = inputChannelCount(deviceID);
+    if (deviceChannels == 0) {
+        printf("The audio device with ID %u has no input channels.\n", deviceID);
+        return 1;
+    }
+
+    ASMeter * meter = (ASMeter *)calloc(1, sizeof(ASMeter));
+    if (meter == NULL) {
+        return 1;
+    }
+    OSStatus status = AudioDeviceCreateIOProcID(deviceID, meterIOProc, meter, &procID);
+    if (status == noErr) {
+        status = AudioDeviceStart(deviceID, procID);
+    }
+    if (status != noErr) {
+        printf("Failed to start metering the audio device with ID %u. Error: %d (%s)\n", deviceID, status, statusErrorString(status));
+        if (procID != NULL) AudioDeviceDestroyIOProcID(deviceID, procID);
+        free(meter);
+        return 1;
+    }
+
+    if (outputRequested == kFormatHuman) {
+        ASCopyDeviceName(context, deviceID, &deviceName);
+        printf("Metering \"%s\" (%u channels).  Press Ctrl-C to stop.\n", deviceName ? deviceName : "", deviceChannels);
+        if (deviceChannels > kMeterMaxChannels) {
+            printf("Only the first %d channels are shown.\n", kMeterMaxChannels);
+        }
+        free(deviceName);
+    }
+
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+    bool interactive = isatty(STDOUT_FILENO);
+    struct timespec interval = {intervalMilliseconds / 1000, (long)(intervalMilliseconds % 1000) * 1000000};
+    UInt64 startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+
+    // the first interval starts now, not when the IOProc was installed
+    readLevels(meter, &channelCount, &frames, peaks, sumsOfSquares);
+    while (!stopRequested) {
+        nanosleep(&interval, NULL);
+        if (stopRequested) {
+            break;
+        }
+        readLevels(meter, &channelCount, &frames, peaks, sumsOfSquares);
+        double elapsed = (double)(clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime) / 1e9;
+        showLevels(channelCount, frames, peaks, sumsOfSquares, elapsed, shownLines, outputRequested);
+        shownLines = (interactive && outputRequested == kFormatHuman) ? channelCount : 0;
+    }
+
+    AudioDeviceStop(deviceID, procID);
+    AudioDeviceDestroyIOProcID(deviceID, procID);
+    free(meter);
+    return 0;
+}
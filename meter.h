@@ -0,0 +1,60 @@
+/*
+ *  meter.h
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+#ifndef METER_H
+#define METER_H
+
+#include "audio_switch.h"
+
+// Input level meter.  An IOProc on the device reduces every buffer to a peak
+// and a sum of squares per channel and publishes them under a sequence
+// counter; the main thread reads them without locking once per interval and
+// starts the next interval by bumping a generation the IOProc picks up.
+
+#define kMeterMaxChannels       64
+#define kMeterDefaultInterval   100    // milliseconds
+#define kMeterFloorDecibels     -120.0
+
+typedef struct {
+	// published by the IOProc
+	UInt32 sequence;                          // odd while the IOProc updates the levels
+	UInt32 channelCount;
+	UInt64 frames;
+	float peaks[kMeterMaxChannels];
+	double sumsOfSquares[kMeterMaxChannels];
+
+	// set by the reader to start a new interval
+	UInt32 resetGeneration;
+
+	// private to the IOProc
+	UInt32 seenGeneration;
+} ASMeter;
+
+int runMeter(ASContext * context, AudioDeviceID deviceID, UInt32 intervalMilliseconds, ASOutputType outputRequested);
+
+#endif
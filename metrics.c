@@ -0,0 +1,237 @@
+/*
+ *  metrics.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <time.h>
+#include "metrics.h"
+
+
+// upper bounds of the histogram buckets in nanoseconds; the last one is +Inf
+static const UInt64 bucketBounds[kMetricsBuckets - 1] = {
+    100000, 250000, 500000, 1000000, 2500000, 5000000,
+    10000000, 25000000, 50000000, 100000000, 250000000
+};
+
+static const char * histogramNames[kHistogramCount] = {
+    "switchaudio_switch_duration_seconds",
+    "switchaudio_lookup_duration_seconds",
+    "switchaudio_enumeration_duration_seconds",
+};
+
+static const char * histogramHelp[kHistogramCount] = {
+    "Time taken to set the default device.",
+    "Time taken to find a device by name or uid.",
+    "Time taken to enumerate the devices.",
+};
+
+static ASMetrics pending;
+static bool pendingChanged = false;
+
+UInt64 metricsNow(void) {
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+void countSwitch(ASDeviceType typeRequested) {
+    // all and unknown write the output default, so they count as output
+    if (typeRequested != kAudioTypeInput && typeRequested != kAudioTypeSystemOutput) {
+        typeRequested = kAudioTypeOutput;
+    }
+    pending.switches[typeRequested]++;
+    pendingChanged = true;
+}
+
+void countLookupFailure(void) {
+    pending.lookupFailures++;
+    pendingChanged = true;
+}
+
+void countHALError(OSStatus status) {
+    pendingChanged = true;
+    for (int i = 0; i < kMetricsErrorSlots; ++i) {
+        if (pending.halErrors[i].status == status || pending.halErrors[i].status == 0) {
+            pending.halErrors[i].status = status;
+            pending.halErrors[i].count++;
+            return;
+        }
+    }
+    pending.otherHALErrors++;
+}
+
+void observeDuration(ASHistogramType histogram, UInt64 startTime) {
+    UInt64 duration = metricsNow() - startTime;
+    int bucket = 0;
+
+    while (bucket < kMetricsBuckets - 1 && duration > bucketBounds[bucket]) {
+        bucket++;
+    }
+    pending.histograms[histogram].buckets[bucket]++;
+    pending.histograms[histogram].count++;
+    pending.histograms[histogram].sumNanoseconds += duration;
+    pendingChanged = true;
+}
+
+static ASMetrics * mapMetrics(void) {
+    char path[1024];
+    const char * tmpdir = getenv("TMPDIR");
+
+    snprintf(path, sizeof(path), "%s/SwitchAudioSource.metrics", (tmpdir && tmpdir[0]) ? tmpdir : "/tmp");
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(ASMetrics)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    void * mapped = mmap(NULL, sizeof(ASMetrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return NULL;
+    }
+
+    // new files are zero filled and claimed with the magic; files with another
+    // layout are left alone rather than reset under concurrent writers
+    ASMetrics * metrics = (ASMetrics *)mapped;
+    UInt32 expected = 0;
+    if (__atomic_compare_exchange_n(&metrics->magic, &expected, kMetricsMagic, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&metrics->version, kMetricsVersion, __ATOMIC_RELEASE);
+    } else if (expected != kMetricsMagic) {
+        munmap(mapped, sizeof(ASMetrics));
+        return NULL;
+    }
+    if (__atomic_load_n(&metrics->version, __ATOMIC_ACQUIRE) != kMetricsVersion) {
+        munmap(mapped, sizeof(ASMetrics));
+        return NULL;
+    }
+    return metrics;
+}
+
+static void addCounter(UInt64 * counter, UInt64 value) {
+    if (value != 0) {
+        __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+    }
+}
+
+// adds the counters collected by this process to the shared ones; registered with atexit()
+void flushMetrics(void) {
+    if (!pendingChanged) {
+        return;
+    }
+    ASMetrics * metrics = mapMetrics();
+    if (metrics == NULL) {
+        return;
+    }
+
+    for (int i = 0; i <= kAudioTypeAll; ++i) {
+        addCounter(&metrics->switches[i], pending.switches[i]);
+    }
+    addCounter(&metrics->lookupFailures, pending.lookupFailures);
+
+    for (int i = 0; i < kMetricsErrorSlots && pending.halErrors[i].status != 0; ++i) {
+        bool added = false;
+        for (int slot = 0; slot < kMetricsErrorSlots && !added; ++slot) {
+            // claim an unused slot, or find the one already counting this status
+            SInt32 expected = 0;
+            __atomic_compare_exchange_n(&metrics->halErrors[slot].status, &expected, pending.halErrors[i].status, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+            if (expected == 0 || expected == pending.halErrors[i].status) {
+                addCounter(&metrics->halErrors[slot].count, pending.halErrors[i].count);
+                added = true;
+            }
+        }
+        if (!added) {
+            addCounter(&metrics->otherHALErrors, pending.halErrors[i].count);
+        }
+    }
+    addCounter(&metrics->otherHALErrors, pending.otherHALErrors);
+
+    for (int h = 0; h < kHistogramCount; ++h) {
+        for (int bucket = 0; bucket < kMetricsBuckets; ++bucket) {
+            addCounter(&metrics->histograms[h].buckets[bucket], pending.histograms[h].buckets[bucket]);
+        }
+        addCounter(&metrics->histograms[h].count, pending.histograms[h].count);
+        addCounter(&metrics->histograms[h].sumNanoseconds, pending.histograms[h].sumNanoseconds);
+    }
+
+    munmap(metrics, sizeof(ASMetrics));
+    memset(&pending, 0, sizeof(pending));
+    pendingChanged = false;
+}
+
+static UInt64 loadCounter(UInt64 * counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+void showMetrics(void) {
+    ASMetrics * metrics = mapMetrics();
+    if (metrics == NULL) {
+        printf("Could not read the metrics.\n");
+        return;
+    }
+
+    printf("# TYPE switchaudio_switches counter\n");
+    printf("# HELP switchaudio_switches Default device changes, by device type.\n");
+    for (int i = kAudioTypeInput; i <= kAudioTypeSystemOutput; ++i) {
+        printf("switchaudio_switches_total{type=\"%s\"} %llu\n", ASDeviceTypeName(i), (unsigned long long)loadCounter(&metrics->switches[i]));
+    }
+
+    printf("# TYPE switchaudio_lookup_failures counter\n");
+    printf("# HELP switchaudio_lookup_failures Requested devices that could not be found.\n");
+    printf("switchaudio_lookup_failures_total %llu\n", (unsigned long long)loadCounter(&metrics->lookupFailures));
+
+    printf("# TYPE switchaudio_hal_errors counter\n");
+    printf("# HELP switchaudio_hal_errors Failed Core Audio calls, by OSStatus.\n");
+    for (int slot = 0; slot < kMetricsErrorSlots; ++slot) {
+        SInt32 status = __atomic_load_n(&metrics->halErrors[slot].status, __ATOMIC_ACQUIRE);
+        if (status == 0) break;
+        printf("switchaudio_hal_errors_total{status=\"%d\"} %llu\n", status, (unsigned long long)loadCounter(&metrics->halErrors[slot].count));
+    }
+    printf("switchaudio_hal_errors_total{status=\"other\"} %llu\n", (unsigned long long)loadCounter(&metrics->otherHALErrors));
+
+    for (int h = 0; h < kHistogramCount; ++h) {
+        UInt64 cumulative = 0;
+        printf("# TYPE %s histogram\n", histogramNames[h]);
+        printf("# HELP %s %s\n", histogramNames[h], histogramHelp[h]);
+        for (int bucket = 0; bucket < kMetricsBuckets; ++bucket) {
+            cumulative += loadCounter(&metrics->histograms[h].buckets[bucket]);
+            if (bucket < kMetricsBuckets - 1) {
+                printf("%s_bucket{le=\"%g\"} %llu\n", histogramNames[h], bucketBounds[bucket] / 1e9, (unsigned long long)cumulative);
+            } else {
+                printf("%s_bucket{le=\"+Inf\"} %llu\n", histogramNames[h], (unsigned long long)cumulative);
+            }
+        }
+        printf("%s_sum %g\n", histogramNames[h], loadCounter(&metrics->histograms[h].sumNanoseconds) / 1e9);
+        // the +Inf bucket, so the count matches it even while an invocation flushes
+        printf("%s_count %llu\n", histogramNames[h], (unsigned long long)cumulative);
+    }
+    printf("# EOF\n");
+
+    munmap(metrics, sizeof(ASMetrics));
+}
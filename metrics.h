@@ -0,0 +1,83 @@
+/*
+ *  metrics.h
+ *  AudioSwitcher
+ *
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ *
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "switchaudio.h"
+
+// Counters and latency histograms shared by all invocations.  They are
+// collected in process memory while running and added atomically to a small
+// memory-mapped file under $TMPDIR at exit, so the switch itself makes no
+// extra system calls.  --metrics renders them in the OpenMetrics text format.
+
+#define kMetricsMagic      'SAmt'
+#define kMetricsVersion    1
+#define kMetricsBuckets    12
+#define kMetricsErrorSlots 16
+
+typedef enum {
+	kHistogramSwitch      = 0,
+	kHistogramLookup      = 1,
+	kHistogramEnumeration = 2,
+	kHistogramCount       = 3,
+} ASHistogramType;
+
+typedef struct {
+	UInt64 buckets[kMetricsBuckets];  // cumulative counts are computed when rendering
+	UInt64 count;
+	UInt64 sumNanoseconds;
+} ASHistogram;
+
+typedef struct {
+	SInt32 status;                    // 0 marks an unused slot
+	UInt32 reserved;
+	UInt64 count;
+} ASErrorCounter;
+
+typedef struct {
+	UInt32 magic;
+	UInt32 version;
+	UInt64 switches[kAudioTypeAll + 1];  // by ASDeviceType
+	UInt64 lookupFailures;
+	ASErrorCounter halErrors[kMetricsErrorSlots];
+	UInt64 otherHALErrors;               // errors not fitting in halErrors
+	ASHistogram histograms[kHistogramCount];
+} ASMetrics;
+
+UInt64 metricsNow(void);
+void countSwitch(ASDeviceType typeRequested);
+void countLookupFailure(void);
+void countHALError(OSStatus status);
+void observeDuration(ASHistogramType histogram, UInt64 startTime);
+void flushMetrics(void);
+void showMetrics(void);
+
+#endif
@@ -0,0 +1,932 @@
+/*
+ *  switchaudio.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "switchaudio.h"
+
+
+#define kASDevicePublishAttempts 200    // 10 ms apart
+
+struct ASContext {
+	ASDeviceInfo * devices;
+	UInt32 deviceCount;
+	bool snapshotValid;
+	bool devicesChanged;                                // set by the listener
+	bool devicesStale;                                  // set by the device listener
+	AudioDeviceID defaultDevices[kAudioTypeAll + 1];    // cached while listening
+	bool defaultsChanged[kAudioTypeAll + 1];            // set by the listener
+	bool listening;
+	ASChangeCallback callback;
+	void * userData;
+};
+
+static const AudioObjectPropertySelector listenedSelectors[] = {
+	kAudioHardwarePropertyDevices,
+	kAudioHardwarePropertyDefaultInputDevice,
+	kAudioHardwarePropertyDefaultOutputDevice,
+	kAudioHardwarePropertyDefaultSystemOutputDevice,
+};
+
+// a rename or a profile switch of a Bluetooth device keeps the device id
+static const AudioObjectPropertySelector deviceSelectors[] = {
+	kAudioObjectPropertyName,
+	kAudioDevicePropertyStreams,
+};
+
+
+static AudioObjectPropertySelector defaultDeviceSelector(ASDeviceType typeRequested) {
+    switch (typeRequested) {
+        case kAudioTypeInput:
+            return kAudioHardwarePropertyDefaultInputDevice;
+        case kAudioTypeSystemOutput:
+            return kAudioHardwarePropertyDefaultSystemOutputDevice;
+        default:
+            return kAudioHardwarePropertyDefaultOutputDevice;
+    }
+}
+
+// index into the default device cache; the output default stands in for unknown and all
+static ASDeviceType defaultDeviceRole(ASDeviceType typeRequested) {
+    return (typeRequested == kAudioTypeInput || typeRequested == kAudioTypeSystemOutput) ? typeRequested : kAudioTypeOutput;
+}
+
+static char * copyCString(CFStringRef string) {
+    if (string == NULL) {
+        return strdup("");
+    }
+    CFIndex maxSize = CFStringGetMaximumSizeForEncoding(CFStringGetLength(string), kCFStringEncodingUTF8) + 1;
+    char * result = (char *)malloc(maxSize);
+    if (result != NULL && !CFStringGetCString(string, result, maxSize, kCFStringEncodingUTF8)) {
+        result[0] = '\0';
+    }
+    return result;
+}
+
+static OSStatus copyStringProperty(AudioObjectID objectID, AudioObjectPropertySelector selector, char ** outString) {
+    AudioObjectPropertyAddress address = {selector, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+    CFStringRef value = NULL;
+    UInt32 dataSize = sizeof(value);
+
+    OSStatus status = AudioObjectGetPropertyData(objectID, &address, 0, NULL, &dataSize, &value);
+    if (status != noErr) {
+        return status;
+    }
+    char * result = copyCString(value);
+    if (value != NULL) {
+        CFRelease(value);
+    }
+    if (result == NULL) {
+        return kASOutOfMemoryError;
+    }
+    *outString = result;
+    return noErr;
+}
+
+static OSStatus readHasStreams(AudioDeviceID deviceID, AudioObjectPropertyScope scope, bool * outHasStreams) {
+    AudioObjectPropertyAddress address = {kAudioDevicePropertyStreams, scope, kAudioObjectPropertyElementMaster};
+    UInt32 dataSize = 0;
+    OSStatus status = AudioObjectGetPropertyDataSize(deviceID, &address, 0, NULL, &dataSize);
+    if (status == noErr) {
+        *outHasStreams = dataSize > 0;
+    }
+    return status;
+}
+
+static OSStatus readIsAggregate(AudioDeviceID deviceID, bool * outIsAggregate) {
+    AudioObjectPropertyAddress address = {kAudioDevicePropertyTransportType, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+    UInt32 transportType = 0;
+    UInt32 dataSize = sizeof(transportType);
+    OSStatus status = AudioObjectGetPropertyData(deviceID, &address, 0, NULL, &dataSize, &transportType);
+    if (status == noErr) {
+        *outIsAggregate = transportType == kAudioDeviceTransportTypeAggregate;
+    }
+    return status;
+}
+
+// for the snapshot, a property that cannot be read counts as absent
+static bool hasStreams(AudioDeviceID deviceID, AudioObjectPropertyScope scope) {
+    bool result = false;
+    readHasStreams(deviceID, scope, &result);
+    return result;
+}
+
+static bool isAggregate(AudioDeviceID deviceID) {
+    bool result = false;
+    readIsAggregate(deviceID, &result);
+    return result;
+}
+
+// a device whose name or uid cannot be read is left out of the snapshot
+static OSStatus readDeviceInfo(AudioDeviceID deviceID, ASDeviceInfo * info) {
+    info->deviceID = deviceID;
+    info->name = NULL;
+    info->uid = NULL;
+    OSStatus status = copyStringProperty(deviceID, kAudioDevicePropertyDeviceNameCFString, &info->name);
+    if (status == noErr) {
+        status = copyStringProperty(deviceID, kAudioDevicePropertyDeviceUID, &info->uid);
+    }
+    if (status != noErr) {
+        free(info->name);
+        free(info->uid);
+        return status;
+    }
+    info->type = hasStreams(deviceID, kAudioObjectPropertyScopeGlobal) ? kAudioTypeOutput : kAudioTypeUnknown;
+    info->hasInput = hasStreams(deviceID, kAudioObjectPropertyScopeInput);
+    info->hasOutput = hasStreams(deviceID, kAudioObjectPropertyScopeOutput);
+    info->isAggregate = isAggregate(deviceID);
+    return noErr;
+}
+
+static OSStatus contextListener(AudioObjectID objectID, UInt32 numberAddresses, const AudioObjectPropertyAddress * addresses, void * clientData) {
+    ASContext * context = (ASContext *)clientData;
+
+    for (UInt32 i = 0; i < numberAddresses; ++i) {
+        switch (addresses[i].mSelector) {
+            case kAudioHardwarePropertyDevices:
+                __atomic_store_n(&context->devicesChanged, true, __ATOMIC_RELEASE);
+                break;
+            case kAudioHardwarePropertyDefaultInputDevice:
+                __atomic_store_n(&context->defaultsChanged[kAudioTypeInput], true, __ATOMIC_RELEASE);
+                break;
+            case kAudioHardwarePropertyDefaultOutputDevice:
+                __atomic_store_n(&context->defaultsChanged[kAudioTypeOutput], true, __ATOMIC_RELEASE);
+                break;
+            case kAudioHardwarePropertyDefaultSystemOutputDevice:
+                __atomic_store_n(&context->defaultsChanged[kAudioTypeSystemOutput], true, __ATOMIC_RELEASE);
+                break;
+            case kAudioObjectPropertyName:
+            case kAudioDevicePropertyStreams:
+                __atomic_store_n(&context->devicesStale, true, __ATOMIC_RELEASE);
+                __atomic_store_n(&context->devicesChanged, true, __ATOMIC_RELEASE);
+                break;
+        }
+    }
+    if (context->callback != NULL) {
+        context->callback(context, context->userData);
+    }
+    return noErr;
+}
+
+// streams are added and removed in the input and output scopes
+static void listenToDevice(ASContext * context, AudioDeviceID deviceID, bool listen) {
+    for (size_t i = 0; i < sizeof(deviceSelectors) / sizeof(deviceSelectors[0]); ++i) {
+        AudioObjectPropertyAddress address = {deviceSelectors[i], kAudioObjectPropertyScopeWildcard, kAudioObjectPropertyElementMaster};
+        if (listen) {
+            AudioObjectAddPropertyListener(deviceID, &address, contextListener, context);
+        } else {
+            AudioObjectRemovePropertyListener(deviceID, &address, contextListener, context);
+        }
+    }
+}
+
+OSStatus ASContextCreate(ASContext ** outContext) {
+    ASContext * context = (ASContext *)calloc(1, sizeof(ASContext));
+    if (context == NULL) {
+        return kASOutOfMemoryError;
+    }
+    *outContext = context;
+    return noErr;
+}
+
+void ASContextDispose(ASContext * context) {
+    if (context == NULL) {
+        return;
+    }
+    if (context->listening) {
+        for (size_t i = 0; i < sizeof(listenedSelectors) / sizeof(listenedSelectors[0]); ++i) {
+            AudioObjectPropertyAddress address = {listenedSelectors[i], kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+            AudioObjectRemovePropertyListener(kAudioObjectSystemObject, &address, contextListener, context);
+        }
+    }
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        if (context->listening) {
+            listenToDevice(context, context->devices[i].deviceID, false);
+        }
+        free(context->devices[i].name);
+        free(context->devices[i].uid);
+    }
+    free(context->devices);
+    free(context);
+}
+
+OSStatus ASContextStartListening(ASContext * context, ASChangeCallback callback, void * userData) {
+    if (context->listening) {
+        return kASInvalidArgumentError;
+    }
+    context->callback = callback;
+    context->userData = userData;
+
+    // nothing cached before listening can be trusted afterwards
+    context->devicesChanged = true;
+    for (int i = 0; i <= kAudioTypeAll; ++i) {
+        context->defaultsChanged[i] = true;
+    }
+
+    for (size_t i = 0; i < sizeof(listenedSelectors) / sizeof(listenedSelectors[0]); ++i) {
+        AudioObjectPropertyAddress address = {listenedSelectors[i], kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+        OSStatus status = AudioObjectAddPropertyListener(kAudioObjectSystemObject, &address, contextListener, context);
+        if (status != noErr) {
+            while (i-- > 0) {
+                address.mSelector = listenedSelectors[i];
+                AudioObjectRemovePropertyListener(kAudioObjectSystemObject, &address, contextListener, context);
+            }
+            return status;
+        }
+    }
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        listenToDevice(context, context->devices[i].deviceID, true);
+    }
+    context->listening = true;
+    return noErr;
+}
+
+// the ids of all devices, without querying the devices themselves
+static OSStatus copyDeviceIDs(AudioDeviceID ** outDeviceIDs, UInt32 * outCount) {
+    AudioObjectPropertyAddress address = {kAudioHardwarePropertyDevices, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+    UInt32 dataSize = 0;
+
+    OSStatus status = AudioObjectGetPropertyDataSize(kAudioObjectSystemObject, &address, 0, NULL, &dataSize);
+    if (status != noErr) {
+        return status;
+    }
+    AudioDeviceID * deviceIDs = (AudioDeviceID *)malloc(dataSize > 0 ? dataSize : 1);
+    if (deviceIDs == NULL) {
+        return kASOutOfMemoryError;
+    }
+    status = AudioObjectGetPropertyData(kAudioObjectSystemObject, &address, 0, NULL, &dataSize, deviceIDs);
+    if (status != noErr) {
+        free(deviceIDs);
+        return status;
+    }
+    *outDeviceIDs = deviceIDs;
+    *outCount = dataSize / sizeof(AudioDeviceID);
+    return noErr;
+}
+
+// Reads the device list.  While listening, devices still present keep their
+// snapshot entry until one of them is renamed or changes its streams, so
+// usually only devices that were added are queried.  Without listening nothing
+// says an entry is still current, so every device is read again.
+OSStatus ASContextRefresh(ASContext * context) {
+    AudioDeviceID * deviceIDs = NULL;
+    UInt32 deviceCount = 0;
+
+    // cleared first so a change arriving while refreshing causes another refresh
+    __atomic_store_n(&context->devicesChanged, false, __ATOMIC_RELEASE);
+    bool stale = __atomic_exchange_n(&context->devicesStale, false, __ATOMIC_ACQ_REL) || !context->listening;
+
+    OSStatus status = copyDeviceIDs(&deviceIDs, &deviceCount);
+    if (status != noErr) {
+        return status;
+    }
+
+    ASDeviceInfo * devices = (ASDeviceInfo *)calloc(deviceCount > 0 ? deviceCount : 1, sizeof(ASDeviceInfo));
+    if (devices == NULL) {
+        free(deviceIDs);
+        return kASOutOfMemoryError;
+    }
+
+    UInt32 count = 0;
+    for (UInt32 i = 0; i < deviceCount; ++i) {
+        ASDeviceInfo * previous = NULL;
+        for (UInt32 j = 0; j < context->deviceCount && previous == NULL; ++j) {
+            if (context->devices[j].deviceID == deviceIDs[i] && context->devices[j].name != NULL) {
+                previous = &context->devices[j];
+            }
+        }
+        if (previous == NULL) {
+            if (readDeviceInfo(deviceIDs[i], &devices[count]) == noErr) {
+                if (context->listening) {
+                    listenToDevice(context, deviceIDs[i], true);
+                }
+                count++;
+            }
+            continue;
+        }
+
+        // a device that cannot be read again keeps its entry
+        if (stale && readDeviceInfo(deviceIDs[i], &devices[count]) == noErr) {
+            free(previous->name);
+            free(previous->uid);
+        } else {
+            devices[count] = *previous;
+        }
+        previous->name = NULL;
+        previous->uid = NULL;
+        count++;
+    }
+    free(deviceIDs);
+
+    // whatever was not taken over belongs to devices that are gone
+    for (UInt32 j = 0; j < context->deviceCount; ++j) {
+        if (context->listening && context->devices[j].name != NULL) {
+            listenToDevice(context, context->devices[j].deviceID, false);
+        }
+        free(context->devices[j].name);
+        free(context->devices[j].uid);
+    }
+    free(context->devices);
+
+    context->devices = devices;
+    context->deviceCount = count;
+    context->snapshotValid = true;
+    return noErr;
+}
+
+static UInt64 appendFingerprint(UInt64 hash, const void * data, size_t length) {
+    const UInt8 * bytes = (const UInt8 *)data;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// FNV-1a over the device ids in HAL order, each followed by its name and
+// whether it has input and output streams
+OSStatus ASGetDeviceListFingerprint(ASContext * context, UInt64 * outFingerprint) {
+    AudioDeviceID * deviceIDs = NULL;
+    UInt32 deviceCount = 0;
+    UInt64 hash = 0xcbf29ce484222325ull;
+
+    OSStatus status = copyDeviceIDs(&deviceIDs, &deviceCount);
+    if (status != noErr) {
+        return status;
+    }
+    for (UInt32 i = 0; i < deviceCount; ++i) {
+        char * name = NULL;
+        UInt8 streams = (hasStreams(deviceIDs[i], kAudioObjectPropertyScopeInput) ? 1 : 0)
+                      | (hasStreams(deviceIDs[i], kAudioObjectPropertyScopeOutput) ? 2 : 0);
+
+        hash = appendFingerprint(hash, &deviceIDs[i], sizeof(deviceIDs[i]));
+        if (copyStringProperty(deviceIDs[i], kAudioDevicePropertyDeviceNameCFString, &name) == noErr) {
+            hash = appendFingerprint(hash, name, strlen(name) + 1);
+            free(name);
+        }
+        hash = appendFingerprint(hash, &streams, sizeof(streams));
+    }
+    free(deviceIDs);
+    *outFingerprint = hash;
+    return noErr;
+}
+
+static OSStatus ensureSnapshot(ASContext * context) {
+    if (!context->snapshotValid || __atomic_load_n(&context->devicesChanged, __ATOMIC_ACQUIRE)) {
+        return ASContextRefresh(context);
+    }
+    return noErr;
+}
+
+OSStatus ASContextGetDevices(ASContext * context, const ASDeviceInfo ** outDevices, UInt32 * outCount) {
+    OSStatus status = ensureSnapshot(context);
+    if (status != noErr) {
+        return status;
+    }
+    *outDevices = context->devices;
+    *outCount = context->deviceCount;
+    return noErr;
+}
+
+const ASDeviceInfo * ASContextFindDevice(ASContext * context, AudioDeviceID deviceID) {
+    if (ensureSnapshot(context) != noErr) {
+        return NULL;
+    }
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        if (context->devices[i].deviceID == deviceID) {
+            return &context->devices[i];
+        }
+    }
+    return NULL;
+}
+
+// looks in the snapshot only if one is already current, so single-device queries never enumerate
+static const ASDeviceInfo * findCachedDevice(ASContext * context, AudioDeviceID deviceID) {
+    if (!context->snapshotValid || __atomic_load_n(&context->devicesChanged, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        if (context->devices[i].deviceID == deviceID) {
+            return &context->devices[i];
+        }
+    }
+    return NULL;
+}
+
+bool ASDeviceMatchesType(const ASDeviceInfo * device, ASDeviceType typeRequested) {
+    switch (typeRequested) {
+        case kAudioTypeInput:
+            return device->hasInput;
+        case kAudioTypeOutput:
+            return device->hasOutput;
+        case kAudioTypeSystemOutput:
+            return device->type == kAudioTypeOutput;
+        default:
+            return true;
+    }
+}
+
+OSStatus ASCopyDevices(ASContext * context, ASDeviceType typeRequested, ASDeviceInfo ** outDevices, UInt32 * outCount) {
+    OSStatus status = ensureSnapshot(context);
+    if (status != noErr) {
+        return status;
+    }
+
+    ASDeviceInfo * devices = (ASDeviceInfo *)calloc(context->deviceCount > 0 ? context->deviceCount : 1, sizeof(ASDeviceInfo));
+    if (devices == NULL) {
+        return kASOutOfMemoryError;
+    }
+    UInt32 count = 0;
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        if (!ASDeviceMatchesType(&context->devices[i], typeRequested)) continue;
+
+        devices[count] = context->devices[i];
+        devices[count].name = strdup(context->devices[i].name);
+        devices[count].uid = strdup(context->devices[i].uid);
+        if (devices[count].name == NULL || devices[count].uid == NULL) {
+            ASFreeDevices(devices, count + 1);
+            return kASOutOfMemoryError;
+        }
+        count++;
+    }
+    *outDevices = devices;
+    *outCount = count;
+    return noErr;
+}
+
+void ASFreeDevices(ASDeviceInfo * devices, UInt32 count) {
+    if (devices == NULL) {
+        return;
+    }
+    for (UInt32 i = 0; i < count; ++i) {
+        free(devices[i].name);
+        free(devices[i].uid);
+    }
+    free(devices);
+}
+
+OSStatus ASFindDeviceByName(ASContext * context, const char * name, ASDeviceType typeRequested, AudioDeviceID * outDeviceID) {
+    OSStatus status = ensureSnapshot(context);
+    if (status != noErr) {
+        return status;
+    }
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        if (ASDeviceMatchesType(&context->devices[i], typeRequested) && strcmp(context->devices[i].name, name) == 0) {
+            *outDeviceID = context->devices[i].deviceID;
+            return noErr;
+        }
+    }
+    return kASDeviceNotFoundError;
+}
+
+OSStatus ASFindDeviceByUIDSubstring(ASContext * context, const char * uid, ASDeviceType typeRequested, AudioDeviceID * outDeviceID) {
+    OSStatus status = ensureSnapshot(context);
+    if (status != noErr) {
+        return status;
+    }
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        if (ASDeviceMatchesType(&context->devices[i], typeRequested) && strstr(context->devices[i].uid, uid) != NULL) {
+            *outDeviceID = context->devices[i].deviceID;
+            return noErr;
+        }
+    }
+    return kASDeviceNotFoundError;
+}
+
+OSStatus ASFindDeviceByNameOrUID(ASContext * context, const char * requested, AudioDeviceID * outDeviceID) {
+    OSStatus status = ASFindDeviceByName(context, requested, kAudioTypeAll, outDeviceID);
+    if (status == kASDeviceNotFoundError) {
+        status = ASFindDeviceByUIDSubstring(context, requested, kAudioTypeAll, outDeviceID);
+    }
+    return status;
+}
+
+OSStatus ASFindDeviceExactly(ASContext * context, const char * requested, AudioDeviceID * outDeviceID) {
+    UInt32 matches = 0;
+
+    OSStatus status = ensureSnapshot(context);
+    if (status != noErr) {
+        return status;
+    }
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        if (strcmp(context->devices[i].name, requested) == 0 || strcmp(context->devices[i].uid, requested) == 0) {
+            *outDeviceID = context->devices[i].deviceID;
+            matches++;
+        }
+    }
+    if (matches == 0) {
+        return kASDeviceNotFoundError;
+    }
+    return matches == 1 ? noErr : kASAmbiguousDeviceError;
+}
+
+OSStatus ASGetNextDevice(ASContext * context, AudioDeviceID currentDeviceID, ASDeviceType typeRequested, UInt32 steps, AudioDeviceID * outDeviceID) {
+    UInt32 numberOfCandidates = 0;
+    int found = -1;
+
+    OSStatus status = ensureSnapshot(context);
+    if (status != noErr) {
+        return status;
+    }
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        if (!ASDeviceMatchesType(&context->devices[i], typeRequested)) continue;
+        if (context->devices[i].deviceID == currentDeviceID) {
+            found = (int)numberOfCandidates;
+        }
+        numberOfCandidates++;
+    }
+    if (numberOfCandidates == 0) {
+        return kASDeviceNotFoundError;
+    }
+
+    // when the current device is not in the list the first step lands on the first device
+    UInt32 target = (UInt32)(found + steps) % numberOfCandidates;
+    for (UInt32 i = 0; i < context->deviceCount; ++i) {
+        if (!ASDeviceMatchesType(&context->devices[i], typeRequested)) continue;
+        if (target-- == 0) {
+            *outDeviceID = context->devices[i].deviceID;
+            break;
+        }
+    }
+    return noErr;
+}
+
+OSStatus ASGetDefaultDevice(ASContext * context, ASDeviceType typeRequested, AudioDeviceID * outDeviceID) {
+    ASDeviceType role = defaultDeviceRole(typeRequested);
+
+    // defaults are only cached while the listener keeps them current
+    if (context->listening && !__atomic_load_n(&context->defaultsChanged[role], __ATOMIC_ACQUIRE)) {
+        *outDeviceID = context->defaultDevices[role];
+        return noErr;
+    }
+
+    AudioObjectPropertyAddress address = {defaultDeviceSelector(typeRequested), kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+    AudioDeviceID deviceID = kAudioDeviceUnknown;
+    UInt32 dataSize = sizeof(deviceID);
+
+    __atomic_store_n(&context->defaultsChanged[role], false, __ATOMIC_RELEASE);
+    OSStatus status = AudioObjectGetPropertyData(kAudioObjectSystemObject, &address, 0, NULL, &dataSize, &deviceID);
+    if (status != noErr) {
+        __atomic_store_n(&context->defaultsChanged[role], true, __ATOMIC_RELEASE);
+        return status;
+    }
+    if (deviceID == kAudioDeviceUnknown) {
+        return kASDeviceNotFoundError;
+    }
+    context->defaultDevices[role] = deviceID;
+    *outDeviceID = deviceID;
+    return noErr;
+}
+
+OSStatus ASSetDefaultDevice(ASContext * context, ASDeviceType typeRequested, AudioDeviceID deviceID) {
+    ASDeviceType role = defaultDeviceRole(typeRequested);
+    AudioObjectPropertyAddress address = {defaultDeviceSelector(typeRequested), kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+
+    OSStatus status = AudioObjectSetPropertyData(kAudioObjectSystemObject, &address, 0, NULL, sizeof(deviceID), &deviceID);
+    if (status == noErr) {
+        context->defaultDevices[role] = deviceID;
+    }
+    return status;
+}
+
+OSStatus ASCopyDeviceName(ASContext * context, AudioDeviceID deviceID, char ** outName) {
+    const ASDeviceInfo * device = findCachedDevice(context, deviceID);
+    if (device == NULL) {
+        return copyStringProperty(deviceID, kAudioDevicePropertyDeviceNameCFString, outName);
+    }
+    char * name = strdup(device->name);
+    if (name == NULL) {
+        return kASOutOfMemoryError;
+    }
+    *outName = name;
+    return noErr;
+}
+
+OSStatus ASCopyDeviceUID(ASContext * context, AudioDeviceID deviceID, char ** outUID) {
+    const ASDeviceInfo * device = findCachedDevice(context, deviceID);
+    if (device == NULL) {
+        return copyStringProperty(deviceID, kAudioDevicePropertyDeviceUID, outUID);
+    }
+    char * uid = strdup(device->uid);
+    if (uid == NULL) {
+        return kASOutOfMemoryError;
+    }
+    *outUID = uid;
+    return noErr;
+}
+
+OSStatus ASGetDeviceCapabilities(ASContext * context, AudioDeviceID deviceID, bool * outHasInput, bool * outHasOutput, bool * outIsAggregate) {
+    const ASDeviceInfo * device = findCachedDevice(context, deviceID);
+    if (device != NULL) {
+        *outHasInput = device->hasInput;
+        *outHasOutput = device->hasOutput;
+        *outIsAggregate = device->isAggregate;
+        return noErr;
+    }
+
+    OSStatus status = readHasStreams(deviceID, kAudioObjectPropertyScopeInput, outHasInput);
+    if (status == noErr) {
+        status = readHasStreams(deviceID, kAudioObjectPropertyScopeOutput, outHasOutput);
+    }
+    if (status == noErr) {
+        status = readIsAggregate(deviceID, outIsAggregate);
+    }
+    return status;
+}
+
+// outMuted receives the resulting mute state
+OSStatus ASSetMute(ASContext * context, ASDeviceType typeRequested, ASMuteType muteRequested, UInt32 * outMuted) {
+    AudioDeviceID deviceID = kAudioDeviceUnknown;
+    AudioObjectPropertyScope scope;
+
+    switch (typeRequested) {
+        case kAudioTypeInput:
+            scope = kAudioObjectPropertyScopeInput;
+            break;
+        case kAudioTypeOutput:
+            scope = kAudioObjectPropertyScopeOutput;
+            break;
+        default:
+            return kASInvalidArgumentError;
+    }
+
+    OSStatus status = ASGetDefaultDevice(context, typeRequested, &deviceID);
+    if (status != noErr) {
+        return status;
+    }
+
+    AudioObjectPropertyAddress address = {kAudioDevicePropertyMute, scope, kAudioObjectPropertyElementMaster};
+    UInt32 muted = (muteRequested == kMute) ? 1 : 0;
+    UInt32 dataSize = sizeof(muted);
+
+    if (muteRequested == kToggleMute) {
+        status = AudioObjectGetPropertyData(deviceID, &address, 0, NULL, &dataSize, &muted);
+        if (status != noErr) {
+            return status;
+        }
+        muted = !muted;
+    }
+
+    status = AudioObjectSetPropertyData(deviceID, &address, 0, NULL, sizeof(muted), &muted);
+    if (status == noErr && outMuted != NULL) {
+        *outMuted = muted;
+    }
+    return status;
+}
+
+void ASFreeStrings(char ** strings, UInt32 count) {
+    if (strings == NULL) {
+        return;
+    }
+    for (UInt32 i = 0; i < count; ++i) {
+        free(strings[i]);
+    }
+    free(strings);
+}
+
+// members are named by their device name, or their uid while unavailable
+OSStatus ASCopyAggregateMembers(ASContext * context, AudioDeviceID deviceID, char *** outMembers, UInt32 * outCount) {
+    AudioObjectPropertyAddress address = {kAudioAggregateDevicePropertyFullSubDeviceList, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+    CFArrayRef subDeviceUIDs = NULL;
+    UInt32 dataSize = sizeof(subDeviceUIDs);
+
+    OSStatus status = ensureSnapshot(context);
+    if (status != noErr) {
+        return status;
+    }
+    status = AudioObjectGetPropertyData(deviceID, &address, 0, NULL, &dataSize, &subDeviceUIDs);
+    if (status != noErr) {
+        return status;
+    }
+    if (subDeviceUIDs == NULL) {
+        return kASNotAggregateError;
+    }
+
+    UInt32 count = (UInt32)CFArrayGetCount(subDeviceUIDs);
+    char ** members = (char **)calloc(count > 0 ? count : 1, sizeof(char *));
+    if (members == NULL) {
+        CFRelease(subDeviceUIDs);
+        return kASOutOfMemoryError;
+    }
+
+    for (UInt32 i = 0; i < count; ++i) {
+        char * uid = copyCString((CFStringRef)CFArrayGetValueAtIndex(subDeviceUIDs, i));
+        if (uid == NULL) {
+            ASFreeStrings(members, i);
+            CFRelease(subDeviceUIDs);
+            return kASOutOfMemoryError;
+        }
+        members[i] = uid;
+        for (UInt32 j = 0; j < context->deviceCount; ++j) {
+            if (strcmp(context->devices[j].uid, uid) == 0) {
+                char * name = strdup(context->devices[j].name);
+                if (name != NULL) {
+                    members[i] = name;
+                    free(uid);
+                }
+                break;
+            }
+        }
+    }
+    CFRelease(subDeviceUIDs);
+
+    *outMembers = members;
+    *outCount = count;
+    return noErr;
+}
+
+static bool isListedDevice(ASContext * context, const char * const * list, UInt32 listCount, AudioDeviceID deviceID) {
+    for (UInt32 i = 0; i < listCount; ++i) {
+        AudioDeviceID listedDeviceID = kAudioDeviceUnknown;
+        if (ASFindDeviceByNameOrUID(context, list[i], &listedDeviceID) == noErr && listedDeviceID == deviceID) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void setDictionaryString(CFMutableDictionaryRef dictionary, CFStringRef key, const char * value) {
+    CFStringRef string = CFStringCreateWithCString(kCFAllocatorDefault, value, kCFStringEncodingUTF8);
+    CFDictionarySetValue(dictionary, key, string);
+    CFRelease(string);
+}
+
+static void setDictionaryInt(CFMutableDictionaryRef dictionary, CFStringRef key, int value) {
+    CFNumberRef number = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &value);
+    CFDictionarySetValue(dictionary, key, number);
+    CFRelease(number);
+}
+
+// the HAL publishes a new device asynchronously; it can be used once its uid resolves
+static OSStatus waitForDevice(const char * uid, AudioDeviceID * outDeviceID) {
+    AudioObjectPropertyAddress address = {kAudioHardwarePropertyTranslateUIDToDevice, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+    CFStringRef uidRef = CFStringCreateWithCString(kCFAllocatorDefault, uid, kCFStringEncodingUTF8);
+    AudioDeviceID deviceID = kAudioDeviceUnknown;
+
+    for (int attempt = 0; attempt < kASDevicePublishAttempts && deviceID == kAudioDeviceUnknown; ++attempt) {
+        UInt32 dataSize = sizeof(deviceID);
+        if (AudioObjectGetPropertyData(kAudioObjectSystemObject, &address, sizeof(uidRef), &uidRef, &dataSize, &deviceID) != noErr) {
+            deviceID = kAudioDeviceUnknown;
+        }
+        if (deviceID == kAudioDeviceUnknown) {
+            CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.01, false);
+        }
+    }
+    CFRelease(uidRef);
+
+    if (deviceID == kAudioDeviceUnknown) {
+        return kASTimeoutError;
+    }
+    *outDeviceID = deviceID;
+    return noErr;
+}
+
+// The clock source defaults to the first member and never gets drift
+// compensation.  Members and the clock are given by name or uid substring.
+OSStatus ASCreateAggregateDevice(ASContext * context, const char * name, const char * const * members, UInt32 memberCount,
+                                 const char * clockMember, const char * const * driftMembers, UInt32 driftCount, bool driftAll,
+                                 ASAggregateType aggregateType, AudioDeviceID * outDeviceID) {
+    AudioDeviceID existingDeviceID = kAudioDeviceUnknown;
+    AudioDeviceID clockDeviceID = kAudioDeviceUnknown;
+    char * clockUID = NULL;
+    char aggregateUID[128];
+    char uuidString[64];
+    OSStatus status;
+
+    if (name == NULL || name[0] == '\0' || memberCount == 0) {
+        return kASInvalidArgumentError;
+    }
+    status = ASFindDeviceByName(context, name, kAudioTypeAll, &existingDeviceID);
+    if (status == noErr) {
+        return kASDeviceExistsError;
+    }
+    if (status != kASDeviceNotFoundError) {
+        return status;
+    }
+
+    if (clockMember != NULL && clockMember[0] != '\0') {
+        status = ASFindDeviceByNameOrUID(context, clockMember, &clockDeviceID);
+        if (status != noErr) {
+            return status;
+        }
+    } else {
+        status = ASFindDeviceByNameOrUID(context, members[0], &clockDeviceID);
+        if (status != noErr) {
+            return status;
+        }
+    }
+    status = ASCopyDeviceUID(context, clockDeviceID, &clockUID);
+    if (status != noErr) {
+        return status;
+    }
+
+    // snapshot entries are only used until the next lookup, which may refresh the snapshot
+    CFMutableArrayRef subDevices = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+    bool clockIsMember = false;
+    for (UInt32 i = 0; i < memberCount; ++i) {
+        AudioDeviceID memberDeviceID = kAudioDeviceUnknown;
+        status = ASFindDeviceByNameOrUID(context, members[i], &memberDeviceID);
+        if (status != noErr) {
+            CFRelease(subDevices);
+            free(clockUID);
+            return status;
+        }
+        const ASDeviceInfo * member = ASContextFindDevice(context, memberDeviceID);
+        if (member == NULL) {
+            CFRelease(subDevices);
+            free(clockUID);
+            return kASDeviceNotFoundError;
+        }
+        bool isClock = (memberDeviceID == clockDeviceID);
+        clockIsMember = clockIsMember || isClock;
+
+        CFMutableDictionaryRef subDevice = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        setDictionaryString(subDevice, CFSTR(kAudioSubDeviceUIDKey), member->uid);
+
+        bool driftCompensation = !isClock && (driftAll || isListedDevice(context, driftMembers, driftCount, memberDeviceID));
+        setDictionaryInt(subDevice, CFSTR(kAudioSubDeviceDriftCompensationKey), driftCompensation ? 1 : 0);
+        CFArrayAppendValue(subDevices, subDevice);
+        CFRelease(subDevice);
+    }
+    if (!clockIsMember) {
+        CFRelease(subDevices);
+        free(clockUID);
+        return kASInvalidArgumentError;
+    }
+
+    CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
+    CFStringRef uuidRef = CFUUIDCreateString(kCFAllocatorDefault, uuid);
+    CFStringGetCString(uuidRef, uuidString, sizeof(uuidString), kCFStringEncodingUTF8);
+    snprintf(aggregateUID, sizeof(aggregateUID), "SwitchAudioSource-%s", uuidString);
+    CFRelease(uuidRef);
+    CFRelease(uuid);
+
+    CFMutableDictionaryRef description = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    setDictionaryString(description, CFSTR(kAudioAggregateDeviceNameKey), name);
+    setDictionaryString(description, CFSTR(kAudioAggregateDeviceUIDKey), aggregateUID);
+    setDictionaryString(description, CFSTR(kAudioAggregateDeviceMasterSubDeviceKey), clockUID);
+    setDictionaryInt(description, CFSTR(kAudioAggregateDeviceIsStackedKey), aggregateType == kAggregateMultiOutput ? 1 : 0);
+    setDictionaryInt(description, CFSTR(kAudioAggregateDeviceIsPrivateKey), 0);
+    CFDictionarySetValue(description, CFSTR(kAudioAggregateDeviceSubDeviceListKey), subDevices);
+
+    status = AudioHardwareCreateAggregateDevice(description, outDeviceID);
+    CFRelease(description);
+    CFRelease(subDevices);
+    free(clockUID);
+
+    if (status == noErr) {
+        __atomic_store_n(&context->devicesChanged, true, __ATOMIC_RELEASE);
+        status = waitForDevice(aggregateUID, outDeviceID);
+    }
+    return status;
+}
+
+OSStatus ASDestroyAggregateDevice(ASContext * context, AudioDeviceID deviceID) {
+    const ASDeviceInfo * device = ASContextFindDevice(context, deviceID);
+    if (device == NULL) {
+        return kASDeviceNotFoundError;
+    }
+    if (!device->isAggregate) {
+        return kASNotAggregateError;
+    }
+
+    OSStatus status = AudioHardwareDestroyAggregateDevice(deviceID);
+    if (status == noErr) {
+        __atomic_store_n(&context->devicesChanged, true, __ATOMIC_RELEASE);
+    }
+    return status;
+}
+
+const char * ASDeviceTypeName(ASDeviceType deviceType) {
+    switch(deviceType) {
+        case kAudioTypeInput: return "input";
+        case kAudioTypeOutput: return "output";
+        case kAudioTypeSystemOutput: return "system";
+        case kAudioTypeAll: return "all";
+        default: return "unknown";
+    }
+}
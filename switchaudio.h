@@ -0,0 +1,141 @@
+/*
+ *  switchaudio.h
+ *  AudioSwitcher
+ *
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ *
+ */
+#ifndef SWITCHAUDIO_H
+#define SWITCHAUDIO_H
+
+#include <stdbool.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <CoreAudio/CoreAudio.h>
+#include <CoreAudio/AudioHardware.h>
+#include <CoreAudio/AudioHardwareBase.h>
+
+// libswitchaudio: finding, switching and muting audio devices.
+//
+// All state lives in an ASContext, which owns a snapshot of the devices and,
+// once listening, keeps it current from HAL notifications.  A context must
+// only be used from one thread at a time; the HAL listeners only set flags
+// and call the change callback.  Functions return noErr, an OSStatus from the
+// HAL or one of the kAS*Error codes below, and never print.  Results that are
+// not borrowed from the context are owned by the caller.
+
+
+typedef enum {
+	kAudioTypeUnknown = 0,
+	kAudioTypeInput   = 1,
+	kAudioTypeOutput  = 2,
+	kAudioTypeSystemOutput = 3,
+	kAudioTypeAll = 4
+} ASDeviceType;
+
+typedef enum {
+	kAggregateNormal      = 0,
+	kAggregateMultiOutput = 1,
+} ASAggregateType;
+
+typedef enum {
+	kUnmute = 0,
+	kMute = 1,
+	kToggleMute = 2,
+} ASMuteType;
+
+enum {
+	kASDeviceNotFoundError  = 'ASnf',
+	kASDeviceExistsError    = 'ASex',
+	kASNotAggregateError    = 'ASna',
+	kASInvalidArgumentError = 'ASia',
+	kASOutOfMemoryError     = 'ASmm',
+	kASTimeoutError         = 'AStm',   // a created device was not published in time
+	kASAmbiguousDeviceError = 'ASam',   // more than one device matches exactly
+};
+
+typedef struct {
+	AudioDeviceID deviceID;
+	char * name;
+	char * uid;
+	ASDeviceType type;   // kAudioTypeOutput for any device with streams, else kAudioTypeUnknown
+	bool hasInput;
+	bool hasOutput;
+	bool isAggregate;
+} ASDeviceInfo;
+
+typedef struct ASContext ASContext;
+
+// called on a HAL thread after the device list, a default device, or the name
+// or streams of a device changed
+typedef void (*ASChangeCallback)(ASContext * context, void * userData);
+
+OSStatus ASContextCreate(ASContext ** outContext);
+// Removing the listeners does not wait for a notification that is already
+// being delivered, so a listening context must not be disposed while the HAL
+// may still call it, e.g. keep it until exit or until the callback is done.
+void ASContextDispose(ASContext * context);
+OSStatus ASContextStartListening(ASContext * context, ASChangeCallback callback, void * userData);
+OSStatus ASContextRefresh(ASContext * context);
+
+// The snapshot is refreshed when needed.  Without listening it is only read
+// once, so callers that do not listen refresh it themselves.  Borrowed
+// devices stay valid until the next refresh.
+OSStatus ASContextGetDevices(ASContext * context, const ASDeviceInfo ** outDevices, UInt32 * outCount);
+const ASDeviceInfo * ASContextFindDevice(ASContext * context, AudioDeviceID deviceID);
+bool ASDeviceMatchesType(const ASDeviceInfo * device, ASDeviceType typeRequested);
+OSStatus ASCopyDevices(ASContext * context, ASDeviceType typeRequested, ASDeviceInfo ** outDevices, UInt32 * outCount);
+void ASFreeDevices(ASDeviceInfo * devices, UInt32 count);
+// changes whenever devices are added, removed, renamed or gain or lose their
+// input or output streams; reads only the ids, names and stream sizes, so it
+// is a cheap check whether a saved copy of the devices is current
+OSStatus ASGetDeviceListFingerprint(ASContext * context, UInt64 * outFingerprint);
+
+OSStatus ASFindDeviceByName(ASContext * context, const char * name, ASDeviceType typeRequested, AudioDeviceID * outDeviceID);
+OSStatus ASFindDeviceByUIDSubstring(ASContext * context, const char * uid, ASDeviceType typeRequested, AudioDeviceID * outDeviceID);
+OSStatus ASFindDeviceByNameOrUID(ASContext * context, const char * requested, AudioDeviceID * outDeviceID);
+// for destructive requests: an exact name or uid, and only if a single device has it
+OSStatus ASFindDeviceExactly(ASContext * context, const char * requested, AudioDeviceID * outDeviceID);
+OSStatus ASGetNextDevice(ASContext * context, AudioDeviceID currentDeviceID, ASDeviceType typeRequested, UInt32 steps, AudioDeviceID * outDeviceID);
+
+OSStatus ASGetDefaultDevice(ASContext * context, ASDeviceType typeRequested, AudioDeviceID * outDeviceID);
+OSStatus ASSetDefaultDevice(ASContext * context, ASDeviceType typeRequested, AudioDeviceID deviceID);
+OSStatus ASCopyDeviceName(ASContext * context, AudioDeviceID deviceID, char ** outName);
+OSStatus ASCopyDeviceUID(ASContext * context, AudioDeviceID deviceID, char ** outUID);
+// the same flags as ASDeviceInfo, without reading the device list
+OSStatus ASGetDeviceCapabilities(ASContext * context, AudioDeviceID deviceID, bool * outHasInput, bool * outHasOutput, bool * outIsAggregate);
+OSStatus ASSetMute(ASContext * context, ASDeviceType typeRequested, ASMuteType muteRequested, UInt32 * outMuted);
+
+OSStatus ASCopyAggregateMembers(ASContext * context, AudioDeviceID deviceID, char *** outMembers, UInt32 * outCount);
+void ASFreeStrings(char ** strings, UInt32 count);
+// returns once the new device can be used, or kASTimeoutError
+OSStatus ASCreateAggregateDevice(ASContext * context, const char * name, const char * const * members, UInt32 memberCount,
+                                 const char * clockMember, const char * const * driftMembers, UInt32 driftCount, bool driftAll,
+                                 ASAggregateType aggregateType, AudioDeviceID * outDeviceID);
+OSStatus ASDestroyAggregateDevice(ASContext * context, AudioDeviceID deviceID);
+
+const char * ASDeviceTypeName(ASDeviceType deviceType);
+
+#endif
@@ -0,0 +1,61 @@
+#!/bin/bash
+#
+# Times the short invocations that run on every keyboard shortcut press and
+# fails when one of them takes longer than the budget on average.
+#
+# usage: tests/bench_startup.sh [binary] [runs] [budget in ms]
+#
+# -m is run twice per round, so the mute state is the same afterwards, and -n
+# is run as many times as there are output devices, so the same device is
+# selected afterwards.
+
+binary=${1:-build/Release/SwitchAudioSource}
+runs=${2:-50}
+budget=${3:-20}
+
+if [ ! -x "$binary" ]; then
+    echo "$binary not found, build it with make first." >&2
+    exit 1
+fi
+
+# the device name may contain commas, the id is always the second field from the end
+current=$("$binary" -c -f cli | awk -F, '{ print $(NF-1) }')
+if [ -z "$current" ]; then
+    echo "Could not read the current output device." >&2
+    exit 1
+fi
+devices=$("$binary" -a -t output -f cli | wc -l)
+
+now() {
+    perl -MTime::HiRes=time -e 'printf "%.0f\n", time * 1000000'
+}
+
+failed=0
+
+# bench name invocations-per-round args...
+bench() {
+    local name=$1 count=$2
+    shift 2
+    local start end i j
+    start=$(now)
+    for ((i = 0; i < runs; i++)); do
+        for ((j = 0; j < count; j++)); do
+            "$binary" "$@" > /dev/null || { echo "$name: $binary $* failed" >&2; exit 1; }
+        done
+    done
+    end=$(now)
+    local average=$(( (end - start) / (runs * count) ))
+    if (( average > budget * 1000 )); then
+        printf '%-12s %6d.%03d ms  over the budget of %d ms\n' "$name" $((average / 1000)) $((average % 1000)) "$budget"
+        failed=1
+    else
+        printf '%-12s %6d.%03d ms\n' "$name" $((average / 1000)) $((average % 1000))
+    fi
+}
+
+bench "-c" 1 -c
+bench "-i $current" 1 -i "$current"
+bench "-m toggle" 2 -t output -m toggle
+bench "-n" "$devices" -n
+
+exit $failed
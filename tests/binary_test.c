@@ -0,0 +1,202 @@
+/*
+ *  binary_test.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+// Encodes devices with the writer and decodes them again, then feeds the
+// decoder truncated and corrupted streams, which must be rejected without
+// reading outside the input.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binary.h"
+#include "test.h"
+
+
+#define kMaxStream      1024
+#define kFuzzRounds     20000
+
+static const char * sampleMembers[] = {"Built-in Microphone", "USB Audio Device"};
+
+static size_t encodeSample(uint8_t * stream) {
+    ASBinaryWriter writer;
+    uint8_t role = kBinaryRoleInput;
+
+    binaryWriterInit(&writer);
+    binaryBeginDevice(&writer, 42, kBinaryTypeInput | kBinaryTypeOutput | kBinaryTypeAggregate, "Aggregate \"A\", caf\xc3\xa9", "AGG-UID-1");
+    for (int i = 0; i < 2; ++i) {
+        binaryAppendField(&writer, kBinaryFieldMember, sampleMembers[i], (uint16_t)strlen(sampleMembers[i]));
+    }
+    binaryEndDevice(&writer);
+    binaryBeginDevice(&writer, 7, kBinaryTypeOutput, "Speakers", "");
+    binaryAppendField(&writer, kBinaryFieldDefault, &role, sizeof(role));
+    binaryEndDevice(&writer);
+
+    FILE * file = tmpfile();
+    expect(file != NULL && binaryWriterFlush(&writer, file) == 0, "flush failed");
+    size_t length = (size_t)ftell(file);
+    rewind(file);
+    expect(length <= kMaxStream && fread(stream, 1, length, file) == length, "read back failed");
+    fclose(file);
+    return length;
+}
+
+static bool equals(const char * string, const char * bytes, uint16_t length) {
+    return strlen(string) == length && memcmp(string, bytes, length) == 0;
+}
+
+static void testRoundTrip(void) {
+    uint8_t stream[kMaxStream];
+    size_t length = encodeSample(stream);
+    size_t offset = 0;
+    ASBinaryDevice device;
+    uint8_t tag;
+    const uint8_t * value;
+    uint16_t valueLength;
+
+    expect(binaryDecodeHeader(stream, length, &offset) == 0 && offset == kBinaryHeaderLength, "header rejected");
+
+    expect(binaryDecodeDevice(stream, length, &offset, &device) == 1, "first device missing");
+    expect(device.deviceID == 42, "first device id %u", device.deviceID);
+    expect(device.typeBits == (kBinaryTypeInput | kBinaryTypeOutput | kBinaryTypeAggregate), "first device type bits %u", device.typeBits);
+    expect(equals("Aggregate \"A\", caf\xc3\xa9", device.name, device.nameLength), "first device name");
+    expect(equals("AGG-UID-1", device.uid, device.uidLength), "first device uid");
+    for (int i = 0; i < 2; ++i) {
+        expect(binaryDecodeField(&device, &tag, &value, &valueLength) == 1, "member %d missing", i);
+        expect(tag == kBinaryFieldMember && equals(sampleMembers[i], (const char *)value, valueLength), "member %d", i);
+    }
+    expect(binaryDecodeField(&device, &tag, &value, &valueLength) == 0, "extra field after the members");
+
+    expect(binaryDecodeDevice(stream, length, &offset, &device) == 1, "second device missing");
+    expect(device.deviceID == 7 && device.typeBits == kBinaryTypeOutput, "second device %u, type bits %u", device.deviceID, device.typeBits);
+    expect(equals("Speakers", device.name, device.nameLength) && device.uidLength == 0, "second device strings");
+    expect(binaryDecodeField(&device, &tag, &value, &valueLength) == 1, "default field missing");
+    expect(tag == kBinaryFieldDefault && valueLength == 1 && value[0] == kBinaryRoleInput, "default field");
+    expect(binaryDecodeField(&device, &tag, &value, &valueLength) == 0, "extra field after the default");
+
+    expect(binaryDecodeDevice(stream, length, &offset, &device) == 0, "stream does not end after two devices");
+}
+
+// a later writer may add header bytes and fields this decoder does not know
+static void testExtensions(void) {
+    static const uint8_t stream[] = {
+        'S', 'A', 'b', 'n', kBinaryVersion, 0, 12, 0, 0xaa, 0xbb, 0xcc, 0xdd,
+        21, 0, 0, 0, 5, 0, 0, 0, kBinaryTypeInput, 3, 0, 'M', 'i', 'c', 0, 0,
+        99, 2, 0, 0xee, 0xff,
+        kBinaryFieldDefault, 1, 0, 1,
+    };
+    size_t offset = 0;
+    ASBinaryDevice device;
+    uint8_t tag;
+    const uint8_t * value;
+    uint16_t valueLength;
+
+    expect(binaryDecodeHeader(stream, sizeof(stream), &offset) == 0 && offset == 12, "longer header rejected");
+    expect(binaryDecodeDevice(stream, sizeof(stream), &offset, &device) == 1, "device after a longer header missing");
+    expect(equals("Mic", device.name, device.nameLength), "device name");
+    expect(binaryDecodeField(&device, &tag, &value, &valueLength) == 1 && tag == 99 && valueLength == 2, "unknown field");
+    expect(binaryDecodeField(&device, &tag, &value, &valueLength) == 1 && tag == kBinaryFieldDefault, "field after the unknown one");
+    expect(binaryDecodeDevice(stream, sizeof(stream), &offset, &device) == 0, "stream does not end");
+
+    uint8_t newer[sizeof(stream)];
+    memcpy(newer, stream, sizeof(stream));
+    newer[4] = kBinaryVersion + 1;
+    expect(binaryDecodeHeader(newer, sizeof(newer), &offset) == -1, "newer version accepted");
+}
+
+// decodes everything and checks that nothing points outside the input;
+// returns the last result of binaryDecodeDevice
+static int decodeAll(const uint8_t * stream, size_t length, int * devices) {
+    size_t offset = 0;
+    ASBinaryDevice device;
+    int result;
+
+    *devices = 0;
+    if (binaryDecodeHeader(stream, length, &offset) != 0) {
+        return -1;
+    }
+    while ((result = binaryDecodeDevice(stream, length, &offset, &device)) == 1) {
+        const uint8_t * end = stream + length;
+        uint8_t tag;
+        const uint8_t * value;
+        uint16_t valueLength;
+
+        (*devices)++;
+        expect(offset <= length, "offset %zu past %zu", offset, length);
+        expect((const uint8_t *)device.name + device.nameLength <= end, "name outside the input");
+        expect((const uint8_t *)device.uid + device.uidLength <= end, "uid outside the input");
+        while (binaryDecodeField(&device, &tag, &value, &valueLength) == 1) {
+            expect(value + valueLength <= end, "field outside the input");
+        }
+    }
+    return result;
+}
+
+static void testTruncation(void) {
+    uint8_t stream[kMaxStream];
+    size_t length = encodeSample(stream);
+    int devices;
+
+    for (size_t cut = 0; cut < length; ++cut) {
+        // copied so a read past the cut is a read past the allocation; a cut
+        // between records is a shorter valid stream
+        uint8_t * truncated = (uint8_t *)malloc(cut > 0 ? cut : 1);
+        memcpy(truncated, stream, cut);
+        int result = decodeAll(truncated, cut, &devices);
+        expect(devices < 2, "cut at %zu: %d devices", cut, devices);
+        expect(result == -1 || (result == 0 && cut >= kBinaryHeaderLength), "cut at %zu: result %d", cut, result);
+        free(truncated);
+    }
+}
+
+static void testCorruption(void) {
+    uint8_t stream[kMaxStream];
+    size_t length = encodeSample(stream);
+    int devices;
+
+    srand(1);
+    for (int round = 0; round < kFuzzRounds; ++round) {
+        uint8_t * corrupted = (uint8_t *)malloc(length);
+        memcpy(corrupted, stream, length);
+        for (int changes = 1 + rand() % 4; changes > 0; --changes) {
+            corrupted[rand() % length] = (uint8_t)rand();
+        }
+        decodeAll(corrupted, length, &devices);
+        free(corrupted);
+    }
+}
+
+int main(void) {
+    testRoundTrip();
+    testExtensions();
+    testTruncation();
+    testCorruption();
+
+    printf("%s: %s\n", __FILE__, failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
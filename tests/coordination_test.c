@@ -0,0 +1,227 @@
+/*
+ *  coordination_test.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+// Stress test of the coordination of concurrent invocations.  Clients are
+// forked processes and the HAL is simulated in shared memory, so the test
+// checks the final device and the number of HAL writes without audio hardware.
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "coordination.h"
+#include "test.h"
+
+
+#define kClients        64
+#define kDevices        5
+#define kWriteLatency   2000    // microseconds a simulated HAL write takes
+
+typedef struct {
+    UInt32 currentDevice;
+    UInt32 writes;
+    UInt32 steps;
+    UInt32 inside;              // clients between acquiring and releasing the switch lock
+    UInt32 overlaps;            // writes that found another client inside
+} ASSimulatedHAL;
+
+static ASSimulatedHAL * hal;
+static bool appliedByThisClient = false;
+
+static void enterHAL(void) {
+    if (__atomic_add_fetch(&hal->inside, 1, __ATOMIC_ACQ_REL) != 1) {
+        __atomic_add_fetch(&hal->overlaps, 1, __ATOMIC_ACQ_REL);
+    }
+    usleep(kWriteLatency);
+}
+
+static void leaveHAL(void) {
+    appliedByThisClient = true;
+    __atomic_add_fetch(&hal->writes, 1, __ATOMIC_ACQ_REL);
+    __atomic_sub_fetch(&hal->inside, 1, __ATOMIC_ACQ_REL);
+}
+
+static int simulatedCycle(ASDeviceType typeRequested, UInt32 steps, void * userData) {
+    enterHAL();
+    hal->currentDevice = (hal->currentDevice + steps) % kDevices;
+    __atomic_add_fetch(&hal->steps, steps, __ATOMIC_ACQ_REL);
+    leaveHAL();
+    return 0;
+}
+
+static int simulatedSet(ASDeviceType typeRequested, void * userData) {
+    enterHAL();
+    hal->currentDevice = *(UInt32 *)userData;
+    leaveHAL();
+    return 0;
+}
+
+// a fresh, already initialized state file; the descriptor can hold the switch lock
+static int resetState(ASCoordinationState ** mapped) {
+    char path[1024];
+    ASCoordinationState initial = {.version = kCoordinationStateVersion};
+
+    snprintf(path, sizeof(path), "%s/SwitchAudioSource.state", getenv("TMPDIR"));
+    unlink(path);
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0 || write(fd, &initial, sizeof(initial)) != sizeof(initial)) {
+        printf("FAIL could not create %s\n", path);
+        exit(1);
+    }
+    *mapped = (ASCoordinationState *)mmap(NULL, sizeof(ASCoordinationState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    memset(hal, 0, sizeof(*hal));
+    return fd;
+}
+
+static bool waitFor(const UInt32 * counter, UInt32 value) {
+    for (int i = 0; i < 10000; ++i) {
+        if (__atomic_load_n(counter, __ATOMIC_ACQUIRE) >= value) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+// forks the clients; each exits 0 when it switched, 2 when it had nothing to do.
+// With a queue counter, each client is started once the one before it has
+// queued, so the clients queue in the order of their index.
+static void startClients(pid_t * clients, bool cycle, const UInt32 * queued) {
+    for (UInt32 i = 0; i < kClients; ++i) {
+        if (queued != NULL) {
+            expect(waitFor(queued, i), "client %u did not queue", i - 1);
+        }
+        clients[i] = fork();
+        if (clients[i] == 0) {
+            UInt32 deviceID = i % kDevices;
+            bool superseded = false;
+            if (cycle) {
+                coordinateCycle(kAudioTypeOutput, simulatedCycle, NULL);
+            } else {
+                coordinateSet(kAudioTypeOutput, simulatedSet, &deviceID, &superseded);
+            }
+            _exit(appliedByThisClient ? 0 : 2);
+        }
+    }
+}
+
+// returns how many clients applied a request and the index of the last one
+static UInt32 waitForClients(pid_t * clients, UInt32 * lastApplied) {
+    UInt32 applied = 0;
+    for (UInt32 i = 0; i < kClients; ++i) {
+        int status = 0;
+        waitpid(clients[i], &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            applied++;
+            *lastApplied = i;
+        }
+    }
+    return applied;
+}
+
+// clients arriving one after another; every press must be applied exactly once
+static void testFreeRunningCycles(void) {
+    ASCoordinationState * state;
+    pid_t clients[kClients];
+    UInt32 last = 0;
+
+    int fd = resetState(&state);
+    startClients(clients, true, NULL);
+    waitForClients(clients, &last);
+
+    expect(hal->steps == kClients, "applied %u steps for %u presses", hal->steps, kClients);
+    expect(hal->writes >= 1 && hal->writes <= kClients, "%u writes for %u presses", hal->writes, kClients);
+    expect(hal->overlaps == 0, "%u writes overlapped", hal->overlaps);
+    expect(hal->currentDevice == kClients % kDevices, "ended on device %u", hal->currentDevice);
+    expect(state->pendingCycles[kAudioTypeOutput] == 0, "%u presses left pending", state->pendingCycles[kAudioTypeOutput]);
+    printf("free running cycles: %u presses, %u writes\n", kClients, hal->writes);
+    close(fd);
+}
+
+// presses arriving while a switch is in progress are folded into one write
+static void testQueuedCycles(void) {
+    ASCoordinationState * state;
+    pid_t clients[kClients];
+    UInt32 last = 0;
+
+    int fd = resetState(&state);
+    flock(fd, LOCK_EX);
+    startClients(clients, true, NULL);
+    expect(waitFor(&state->pendingCycles[kAudioTypeOutput], kClients), "only %u presses were queued", state->pendingCycles[kAudioTypeOutput]);
+    flock(fd, LOCK_UN);
+    UInt32 applied = waitForClients(clients, &last);
+
+    expect(hal->writes == 1, "%u writes for queued presses", hal->writes);
+    expect(applied == 1, "%u clients applied presses", applied);
+    expect(hal->steps == kClients, "applied %u steps for %u presses", hal->steps, kClients);
+    expect(hal->currentDevice == kClients % kDevices, "ended on device %u", hal->currentDevice);
+    close(fd);
+}
+
+// queued set requests resolve to one write of the one queued last
+static void testQueuedSets(void) {
+    ASCoordinationState * state;
+    pid_t clients[kClients];
+    UInt32 last = kClients;
+
+    int fd = resetState(&state);
+    flock(fd, LOCK_EX);
+    startClients(clients, false, &state->setSequence[kAudioTypeOutput]);
+    expect(waitFor(&state->setSequence[kAudioTypeOutput], kClients), "only %u sets were queued", state->setSequence[kAudioTypeOutput]);
+    flock(fd, LOCK_UN);
+    UInt32 applied = waitForClients(clients, &last);
+
+    expect(hal->writes == 1, "%u writes for queued sets", hal->writes);
+    expect(applied == 1, "%u clients switched", applied);
+    expect(last == kClients - 1, "client %u switched instead of the last one queued", last);
+    expect(hal->currentDevice == (kClients - 1) % kDevices, "ended on device %u instead of %u", hal->currentDevice, (kClients - 1) % kDevices);
+    close(fd);
+}
+
+int main(void) {
+    char directory[] = "/tmp/coordination_test.XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        return 1;
+    }
+    setenv("TMPDIR", directory, 1);
+    hal = (ASSimulatedHAL *)mmap(NULL, sizeof(ASSimulatedHAL), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+
+    testFreeRunningCycles();
+    testQueuedCycles();
+    testQueuedSets();
+
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/SwitchAudioSource.state", directory);
+    unlink(path);
+    rmdir(directory);
+
+    printf("%s: %s\n", __FILE__, failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+/*
+ *  correlation_bench.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+// Time of finding the latency test signal in a capture at common sample
+// rates, next to correlating every lag directly for the smallest one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "correlation.h"
+
+
+#define kRuns           5
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+static void makeNoise(float * samples, size_t count, float amplitude, unsigned * state) {
+    for (size_t i = 0; i < count; ++i) {
+        *state ^= *state << 13;
+        *state ^= *state >> 17;
+        *state ^= *state << 5;
+        samples[i] = ((float)(*state >> 8) / (float)(1 << 23) - 1.0f) * amplitude;
+    }
+}
+
+static size_t directDelay(const float * signal, size_t signalCount, const float * capture, size_t captureCount) {
+    size_t bestLag = 0;
+    double bestValue = -1.0;
+    for (size_t lag = 0; lag + signalCount <= captureCount; ++lag) {
+        double sum = 0.0;
+        for (size_t i = 0; i < signalCount; ++i) {
+            sum += (double)signal[i] * capture[lag + i];
+        }
+        if ((sum < 0.0 ? -sum : sum) > bestValue) {
+            bestValue = sum < 0.0 ? -sum : sum;
+            bestLag = lag;
+        }
+    }
+    return bestLag;
+}
+
+int main(void) {
+    static const double sampleRates[] = {44100.0, 48000.0, 96000.0};
+    unsigned state = 0x9e3779b9;
+    int failures = 0;
+
+    printf("0.2 s signal in a 1.2 s capture, ms per search\n");
+    printf("    rate      fft   direct\n");
+    for (size_t r = 0; r < sizeof(sampleRates) / sizeof(sampleRates[0]); ++r) {
+        size_t signalCount = (size_t)(sampleRates[r] * 0.2);
+        size_t captureCount = signalCount + (size_t)sampleRates[r];
+        size_t expected = captureCount / 3;
+        float * signal = (float *)malloc(signalCount * sizeof(float));
+        float * capture = (float *)malloc(captureCount * sizeof(float));
+
+        makeNoise(signal, signalCount, 0.25f, &state);
+        makeNoise(capture, captureCount, 0.01f, &state);
+        for (size_t i = 0; i < signalCount; ++i) {
+            capture[expected + i] -= signal[i] * 0.3f;
+        }
+
+        size_t delay = 0;
+        double correlation = 0.0;
+        double start = now();
+        for (int run = 0; run < kRuns; ++run) {
+            findSignalDelay(signal, signalCount, capture, captureCount, &delay, &correlation);
+        }
+        double fft = (now() - start) / kRuns;
+        failures += delay != expected;
+
+        // the direct search takes seconds, so it only runs once at the lowest rate
+        if (r == 0) {
+            start = now();
+            failures += directDelay(signal, signalCount, capture, captureCount) != expected;
+            printf("%8.0f %8.1f %8.1f\n", sampleRates[r], fft, now() - start);
+        } else {
+            printf("%8.0f %8.1f        -\n", sampleRates[r], fft);
+        }
+        free(signal);
+        free(capture);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+/*
+ *  correlation_test.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+// Finds synthetic delayed copies of a noise burst in noise, of both
+// polarities, the way the latency measurement finds its test signal.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "correlation.h"
+#include "test.h"
+
+
+#define kSignalCount    9600    // 0.2 s at 48 kHz
+#define kCaptureCount   57600   // the signal and a 1 s window
+
+static void makeNoise(float * samples, size_t count, float amplitude, unsigned * state) {
+    for (size_t i = 0; i < count; ++i) {
+        *state ^= *state << 13;
+        *state ^= *state >> 17;
+        *state ^= *state << 5;
+        samples[i] = ((float)(*state >> 8) / (float)(1 << 23) - 1.0f) * amplitude;
+    }
+}
+
+static void testDelays(const float * signal, float * capture) {
+    static const size_t delays[] = {0, 1, 7, 480, 1234, 20000, kCaptureCount - kSignalCount};
+    unsigned state = 12345;
+
+    for (size_t i = 0; i < sizeof(delays) / sizeof(delays[0]); ++i) {
+        for (int polarity = 1; polarity >= -1; polarity -= 2) {
+            makeNoise(capture, kCaptureCount, 0.01f, &state);
+            for (size_t j = 0; j < kSignalCount; ++j) {
+                capture[delays[i] + j] += signal[j] * 0.3f * polarity;
+            }
+            size_t delay = 0;
+            double correlation = 0.0;
+            expect(findSignalDelay(signal, kSignalCount, capture, kCaptureCount, &delay, &correlation) == 0, "delay %zu failed", delays[i]);
+            expect(delay == delays[i], "polarity %d: found delay %zu, expected %zu", polarity, delay, delays[i]);
+            expect(correlation > 0.9 && correlation <= 1.0, "polarity %d delay %zu: correlation %.3f", polarity, delays[i], correlation);
+        }
+    }
+}
+
+static void testExactCopy(const float * signal, float * capture) {
+    size_t delay = 0;
+    double correlation = 0.0;
+
+    for (size_t i = 0; i < kCaptureCount; ++i) {
+        capture[i] = 0.0f;
+    }
+    for (size_t i = 0; i < kSignalCount; ++i) {
+        capture[333 + i] = -2.0f * signal[i];
+    }
+    expect(findSignalDelay(signal, kSignalCount, capture, kCaptureCount, &delay, &correlation) == 0, "exact copy failed");
+    expect(delay == 333, "exact copy: found delay %zu", delay);
+    expect(fabs(correlation - 1.0) < 1e-6, "exact copy: correlation %.9f", correlation);
+}
+
+static void testNoMatch(const float * signal, float * capture) {
+    unsigned state = 999;
+    size_t delay = 0;
+    double correlation = 0.0;
+
+    makeNoise(capture, kCaptureCount, 0.01f, &state);
+    expect(findSignalDelay(signal, kSignalCount, capture, kCaptureCount, &delay, &correlation) == 0, "noise failed");
+    expect(correlation < 0.1, "noise: correlation %.3f", correlation);
+}
+
+static void testArguments(const float * signal, float * capture) {
+    size_t delay = 0;
+    double correlation = 0.0;
+
+    expect(findSignalDelay(signal, 0, capture, kCaptureCount, &delay, &correlation) == -1, "empty signal accepted");
+    expect(findSignalDelay(signal, kSignalCount, capture, kSignalCount - 1, &delay, &correlation) == -1, "short capture accepted");
+
+    // a capture exactly as long as the signal has a single lag
+    for (size_t i = 0; i < kSignalCount; ++i) {
+        capture[i] = signal[i];
+    }
+    expect(findSignalDelay(signal, kSignalCount, capture, kSignalCount, &delay, &correlation) == 0, "equal lengths failed");
+    expect(delay == 0, "equal lengths: found delay %zu", delay);
+}
+
+int main(void) {
+    float * signal = (float *)malloc(kSignalCount * sizeof(float));
+    float * capture = (float *)malloc(kCaptureCount * sizeof(float));
+    unsigned state = 0x9e3779b9;
+
+    makeNoise(signal, kSignalCount, 0.25f, &state);
+    testDelays(signal, capture);
+    testExactCopy(signal, capture);
+    testNoMatch(signal, capture);
+    testArguments(signal, capture);
+
+    free(signal);
+    free(capture);
+    printf("%s: %s\n", __FILE__, failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+/*
+ *  levels_bench.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+// Time per buffer of the levels kernels, next to a scalar loop and, for
+// interleaved buffers, to copying each channel out before running the
+// contiguous kernel.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "levels.h"
+
+
+#define kFrames         512     // a typical IOProc buffer
+#define kRuns           20000
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+static void scalarLevels(const float * samples, size_t frames, unsigned stride, float * peaks, float * sums) {
+    for (size_t f = 0; f < frames; ++f) {
+        for (unsigned c = 0; c < stride; ++c) {
+            float sample = samples[f * stride + c];
+            if (fabsf(sample) > peaks[c]) peaks[c] = fabsf(sample);
+            sums[c] += sample * sample;
+        }
+    }
+}
+
+static void gatheredLevels(const float * samples, size_t frames, unsigned stride, float * peaks, float * sums) {
+    float scratch[kFrames];
+    for (unsigned c = 0; c < stride; ++c) {
+        for (size_t f = 0; f < frames; ++f) {
+            scratch[f] = samples[f * stride + c];
+        }
+        accumulateLevels(scratch, frames, &peaks[c], &sums[c]);
+    }
+}
+
+static void interleavedLevels(const float * samples, size_t frames, unsigned stride, float * peaks, float * sums) {
+    accumulateInterleavedLevels(samples, frames, stride, stride, peaks, sums);
+}
+
+static double timeKernel(void (*kernel)(const float *, size_t, unsigned, float *, float *), const float * samples, unsigned stride, float * check) {
+    float peaks[16] = {0}, sums[16] = {0};
+    double start = now();
+    for (int run = 0; run < kRuns; ++run) {
+        kernel(samples, kFrames, stride, peaks, sums);
+    }
+    double elapsed = (now() - start) / kRuns;
+    // keeps the compiler from dropping the runs
+    *check += peaks[0] + sums[0];
+    return elapsed;
+}
+
+int main(void) {
+    static const unsigned strides[] = {1, 2, 4, 6, 8, 16};
+    float * samples = (float *)malloc(kFrames * 16 * sizeof(float));
+    float check = 0.0f;
+
+    for (size_t i = 0; i < kFrames * 16; ++i) {
+        samples[i] = sinf(i * 0.01f) * 0.5f;
+    }
+
+    printf("%d frames, ns per buffer\n", kFrames);
+    printf("stride   scalar  gathered  interleaved\n");
+    for (size_t i = 0; i < sizeof(strides) / sizeof(strides[0]); ++i) {
+        unsigned stride = strides[i];
+        printf("%6u %8.0f %9.0f %12.0f\n", stride,
+               timeKernel(scalarLevels, samples, stride, &check),
+               timeKernel(gatheredLevels, samples, stride, &check),
+               timeKernel(interleavedLevels, samples, stride, &check));
+    }
+
+    free(samples);
+    return check == 0.0f;
+}
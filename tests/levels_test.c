@@ -0,0 +1,125 @@
+/*
+ *  levels_test.c
+ *  AudioSwitcher
+
+Copyright (c) 2008 Devon Weller <wellerco@gmail.com>
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+// Compares the levels kernels with a plain scalar loop, for every length that
+// exercises the vector, tail and block paths and for unaligned buffers.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "levels.h"
+#include "test.h"
+
+
+#define kMaxCount       300
+#define kMaxStride      12
+
+static void referenceLevels(const float * samples, size_t frames, unsigned stride, unsigned channel, float * peak, double * sumOfSquares) {
+    for (size_t f = 0; f < frames; ++f) {
+        float sample = samples[f * stride + channel];
+        if (fabsf(sample) > *peak) *peak = fabsf(sample);
+        *sumOfSquares += (double)sample * sample;
+    }
+}
+
+static bool closeEnough(float sum, double reference) {
+    return fabs(sum - reference) <= 1e-5 * (reference + 1.0);
+}
+
+static void fill(float * samples, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+    }
+}
+
+static void testContiguous(void) {
+    float * buffer = (float *)malloc((kMaxCount + 4) * sizeof(float));
+
+    for (size_t count = 0; count < kMaxCount; ++count) {
+        for (size_t offset = 0; offset < 4; ++offset) {
+            fill(buffer, kMaxCount + 4);
+            float peak = 0.0f, sumOfSquares = 0.0f;
+            float referencePeak = 0.0f;
+            double referenceSum = 0.0;
+            accumulateLevels(buffer + offset, count, &peak, &sumOfSquares);
+            referenceLevels(buffer + offset, count, 1, 0, &referencePeak, &referenceSum);
+            expect(peak == referencePeak, "count %zu offset %zu: peak %g, expected %g", count, offset, peak, referencePeak);
+            expect(closeEnough(sumOfSquares, referenceSum), "count %zu offset %zu: sum %g, expected %g", count, offset, sumOfSquares, referenceSum);
+        }
+    }
+
+    // peak and sum are accumulated into, so a channel can be fed in pieces
+    fill(buffer, kMaxCount);
+    float peak = 0.0f, sumOfSquares = 0.0f;
+    float referencePeak = 0.0f;
+    double referenceSum = 0.0;
+    accumulateLevels(buffer, 37, &peak, &sumOfSquares);
+    accumulateLevels(buffer + 37, kMaxCount - 37, &peak, &sumOfSquares);
+    referenceLevels(buffer, kMaxCount, 1, 0, &referencePeak, &referenceSum);
+    expect(peak == referencePeak, "pieces: peak %g, expected %g", peak, referencePeak);
+    expect(closeEnough(sumOfSquares, referenceSum), "pieces: sum %g, expected %g", sumOfSquares, referenceSum);
+    free(buffer);
+}
+
+static void testInterleaved(void) {
+    float * buffer = (float *)malloc((kMaxCount * kMaxStride + 4) * sizeof(float));
+
+    for (unsigned stride = 1; stride <= kMaxStride; ++stride) {
+        for (size_t frames = 0; frames < kMaxCount; frames += (frames < 20 ? 1 : 17)) {
+            for (size_t offset = 0; offset < 4; ++offset) {
+                // fewer channels than the stride, as for the last buffer of a wide device
+                unsigned channels = (offset == 3 && stride > 1) ? stride - 1 : stride;
+                float peaks[kMaxStride] = {0}, sums[kMaxStride] = {0};
+                fill(buffer, kMaxCount * kMaxStride + 4);
+                accumulateInterleavedLevels(buffer + offset, frames, stride, channels, peaks, sums);
+
+                for (unsigned c = 0; c < stride; ++c) {
+                    float referencePeak = 0.0f;
+                    double referenceSum = 0.0;
+                    if (c < channels) {
+                        referenceLevels(buffer + offset, frames, stride, c, &referencePeak, &referenceSum);
+                    }
+                    expect(peaks[c] == referencePeak, "stride %u frames %zu offset %zu channel %u: peak %g, expected %g", stride, frames, offset, c, peaks[c], referencePeak);
+                    expect(closeEnough(sums[c], referenceSum), "stride %u frames %zu offset %zu channel %u: sum %g, expected %g", stride, frames, offset, c, sums[c], referenceSum);
+                }
+            }
+        }
+    }
+    free(buffer);
+}
+
+int main(void) {
+    srand(1);
+    testContiguous();
+    testInterleaved();
+
+    printf("%s: %s\n", __FILE__, failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}